@@ -0,0 +1,115 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "risk.h"
+
+#define ARENA_ALIGN 64 /* Every allocation starts on its own cache line */
+
+/* Bytes an allocation of size takes in an arena */
+static inline size_t arena_round(size_t size) { return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1); }
+
+/**
+ * @struct arena
+ * @brief One block of memory handed out front to back
+ *
+ * Allocations come back zero-filled and are never freed one by one. arena_mark() remembers how
+ * far the arena is used and arena_reset() gives everything allocated since back, so repeated
+ * games reuse the same memory. A shared arena is a single MAP_SHARED mapping, still visible to
+ * processes forked after it was created.
+ *
+ * The block comes from calloc() or mmap(), both of which hand out fresh zero pages, so nothing
+ * is written until an allocation is first used. That keeps first-touch page placement working.
+ */
+typedef struct arena
+{
+    void* block; /* What to free, base rounded up to ARENA_ALIGN */
+    char* base;
+    size_t size;
+    size_t used;
+    int shared;
+} arena_t;
+
+/**
+ * @brief Sets up an arena of at least size bytes
+ *
+ * @param shared Nonzero to keep the arena in a shared mapping
+ */
+void init_arena(arena_t* a, size_t size, int shared)
+{
+    a->size = arena_round(size);
+    a->used = 0;
+    a->shared = shared;
+    if (shared)
+        a->block = a->base = map_shared(a->size ? a->size : ARENA_ALIGN);
+    else
+    {
+        if (!(a->block = calloc(1, a->size + ARENA_ALIGN)))
+            ERR("calloc");
+        a->base = (char*)arena_round((uintptr_t)a->block);
+    }
+}
+
+void destroy_arena(arena_t* a)
+{
+    if (a->shared)
+        unmap_shared(a->block, a->size ? a->size : ARENA_ALIGN);
+    else
+        free(a->block);
+    a->block = a->base = NULL;
+}
+
+/* size zero-filled bytes, aligned to ARENA_ALIGN. Running out means the arena was sized wrong. */
+void* arena_alloc(arena_t* a, size_t size)
+{
+    size_t need = arena_round(size);
+    if (need > a->size - a->used)
+    {
+        fprintf(stderr, "Arena of %zu bytes exhausted by an allocation of %zu\n", a->size, size);
+        exit(EXIT_FAILURE);
+    }
+    void* p = a->base + a->used;
+    a->used += need;
+    return p;
+}
+
+/* Bytes an allocation of size takes with arena_alloc_pages(), padding to a page boundary included */
+static inline size_t arena_page_round(size_t size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page + page;
+}
+
+/*
+ * size zero-filled bytes on pages of their own: the allocation starts on a page boundary and the
+ * next one starts on a fresh page, so writes to neighboring allocations never fault its pages in
+ * (see first_touch)
+ */
+void* arena_alloc_pages(arena_t* a, size_t size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = ((uintptr_t)(a->base + a->used) + page - 1) / page * page - (uintptr_t)a->base;
+    size_t end = start + (size + page - 1) / page * page;
+    if (end > a->size)
+    {
+        fprintf(stderr, "Arena of %zu bytes exhausted by an allocation of %zu\n", a->size, size);
+        exit(EXIT_FAILURE);
+    }
+    a->used = end;
+    return a->base + start;
+}
+
+static inline size_t arena_mark(const arena_t* a) { return a->used; }
+
+/* Frees everything allocated since mark, zeroing it for the next user */
+void arena_reset(arena_t* a, size_t mark)
+{
+    memset(a->base + mark, 0, a->used - mark);
+    a->used = mark;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "risk.h"
+#include "locks.h"
+#include "owners.h"
+
+/*
+ * Throughput of the bare move path: build the lock set of a random region,
+ * lock it, check the owners a move would read, unlock. Nothing is claimed,
+ * so every thread keeps hitting the locks for the whole run.
+ */
+
+#define BENCH_MS 1000
+#define BENCH_MAX_THREADS 64
+
+static const char *lock_modes[] = {"LOCK_MUTEX", "LOCK_STRIPED", "LOCK_SPIN"};
+
+typedef struct {
+    const region_t *regions;
+    owners_t *owners;
+    region_locks_t *locks;
+    int num_regions;
+    int *stop;
+} board_t;
+
+typedef struct {
+    board_t *board;
+    unsigned seed;
+    long moves;
+} worker_t;
+
+void usage(int argc, char** argv)
+{
+    fprintf(stderr, "USAGE: %s levelname.risk [threads]\n", argv[0]);
+    exit(EXIT_FAILURE);
+}
+
+void* bench_thread(void* arg)
+{
+    worker_t *w = arg;
+    board_t *b = w->board;
+    int ids[MAX_LOCK_SET], keys[MAX_LOCK_SET];
+
+    while (!__atomic_load_n(b->stop, __ATOMIC_RELAXED)) {
+        int r = rand_r(&w->seed) % b->num_regions;
+        const region_t *reg = &b->regions[r];
+
+        int count = 0;
+        ids[count++] = r;
+        for (int i = 0; i < reg->num_neighbors; i++)
+            ids[count++] = reg->neighbors[i];
+        count = lock_set(b->locks, ids, count, keys);
+
+        lock_regions(b->locks, keys, count);
+        int legal = 0;
+        for (int i = 0; i < reg->num_neighbors; i++)
+            legal |= owner_get(b->owners, reg->neighbors[i]) == 1;
+        legal &= owner_get(b->owners, r) != 1;
+        unlock_regions(b->locks, keys, count);
+
+        (void)legal; /* Never claimed, see above */
+        w->moves++;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2 && argc != 3)
+        usage(argc, argv);
+    int threads = argc == 3 ? atoi(argv[2]) : 1;
+    if (threads < 1 || threads > BENCH_MAX_THREADS)
+        usage(argc, argv);
+
+    int num_regions;
+    region_t *regions = load_regions(argv[1], &num_regions);
+    if (num_regions < 1)
+        usage(argc, argv);
+
+    owners_t owners;
+    init_owners(&owners, num_regions);
+    region_locks_t locks;
+    init_region_locks(&locks, num_regions, NULL);
+
+    int stop = 0;
+    board_t board = {regions, &owners, &locks, num_regions, &stop};
+    pthread_t tids[BENCH_MAX_THREADS];
+    worker_t workers[BENCH_MAX_THREADS];
+    for (int i = 0; i < threads; i++) {
+        workers[i] = (worker_t){.board = &board, .seed = i + 1, .moves = 0};
+        if (pthread_create(&tids[i], NULL, bench_thread, &workers[i]))
+            ERR("pthread_create");
+    }
+
+    ms_sleep(BENCH_MS);
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+    long moves = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        moves += workers[i].moves;
+    }
+
+    printf("%s, %d locks (%zu B), threads: %d, %.2f M moves/s\n", lock_modes[LOCK_MODE], locks.count,
+           region_locks_size(&locks), threads, moves / (BENCH_MS / 1000.0) / 1e6);
+
+    destroy_region_locks(&locks);
+    destroy_owners(&owners);
+    free(regions);
+    return 0;
+}
@@ -0,0 +1,195 @@
+#ifndef BOARD_SHM_H
+#define BOARD_SHM_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "owners.h"
+#include "risk.h"
+
+#define BOARD_SHM_MAGIC 0x4b534952u /* "RISK" */
+
+/* One slot per writer: Robin Hood uses slot 0, players use their owner code */
+#define BOARD_WRITERS (MAX_OWNER_CODE + 1)
+#define ROBIN_HOOD_WRITER 0
+
+#ifndef BOARD_PAGE
+#define BOARD_PAGE 4096 /* Page size the owner words are aligned to, so that first touch places them apart from the header */
+#endif
+
+/*
+ * What one writer publishes, on cache lines no other writer touches. Only the writer changes its
+ * slot, so every update is a plain store, never a read-modify-write shared with other writers.
+ */
+typedef struct board_seq
+{
+    _Alignas(64) uint64_t seq;
+    uint64_t generation;                /* Ownership changes made by this writer */
+    int32_t scores[MAX_OWNER_CODE + 1]; /* This writer's net change to the regions of every owner code */
+} board_seq_t;
+
+/**
+ * @struct board_shm
+ * @brief Published game state, laid out for sharing with viewer processes
+ *
+ * The engine plays directly on words, so publishing a move costs a few stores to the writer's
+ * own slot: the sequence counter around the move, its generation and its score deltas. Each
+ * writer owns one counter (a seqlock per writer, since a single counter cannot tell two
+ * overlapping writers apart): it is odd while that writer changes the board. A reader takes a
+ * consistent snapshot by reading all counters, copying, and checking that all counters were even
+ * and unchanged. The generation and scores of the board are the sums over all writers (see
+ * board_shm_snapshot).
+ */
+typedef struct board_shm
+{
+    uint32_t magic;
+    uint32_t owner_bits;
+    uint64_t num_regions;
+    int32_t finished; /* Set once the game is over, viewers may exit */
+    board_seq_t writers[BOARD_WRITERS];
+    _Alignas(BOARD_PAGE) uint64_t words[]; /* Packed owners, see owners.h, off the header's page */
+} board_shm_t;
+
+static inline size_t board_shm_size(size_t num_regions)
+{
+    return sizeof(board_shm_t) + owners_words(num_regions) * sizeof(uint64_t);
+}
+
+/* Arena bytes taken by create_board_shm(), a named board lives in its own segment */
+static inline size_t board_shm_arena_size(const char* name, size_t num_regions)
+{
+    return name ? 0 : arena_page_round(board_shm_size(num_regions));
+}
+
+/**
+ * @brief Creates the published board
+ *
+ * @param name POSIX shared memory name (e.g. "/risk"), or NULL to take the board from arena
+ * @param num_regions The number of regions on the board
+ * @param owners Set up to play on the board's packed owner array
+ * @param arena Holds the board when it has no name, shared if player processes play on it
+ * @return The mapped board, all regions unowned
+ */
+board_shm_t* create_board_shm(const char* name, size_t num_regions, owners_t* owners, arena_t* arena)
+{
+    size_t size = board_shm_size(num_regions);
+    board_shm_t* b;
+    if (name)
+    {
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1)
+            ERR("shm_open");
+        if (ftruncate(fd, size) == -1)
+            ERR("ftruncate");
+        b = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (b == MAP_FAILED)
+            ERR("mmap");
+        close(fd);
+    }
+    else
+        b = arena_alloc_pages(arena, size);
+
+    b->owner_bits = OWNER_BITS;
+    b->num_regions = num_regions;
+    owners->words = b->words;
+    owners->count = num_regions;
+    /* Written last, a viewer attaching early waits until the header is complete */
+    __atomic_store_n(&b->magic, BOARD_SHM_MAGIC, __ATOMIC_RELEASE);
+    return b;
+}
+
+/* Tells viewers the game is over and drops the segment; an unnamed board goes back with its arena */
+void destroy_board_shm(board_shm_t* b, const char* name)
+{
+    __atomic_store_n(&b->finished, 1, __ATOMIC_RELEASE);
+    if (!name)
+        return;
+    if (munmap(b, board_shm_size(b->num_regions)) == -1)
+        ERR("munmap");
+    if (shm_unlink(name) == -1)
+        ERR("shm_unlink");
+}
+
+/* Brackets one writer's changes to words and scores */
+static inline void board_write_begin(board_shm_t* b, int writer)
+{
+    uint64_t* seq = &b->writers[writer].seq;
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void board_write_end(board_shm_t* b, int writer)
+{
+    uint64_t* seq = &b->writers[writer].seq;
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Closes the write section of a writer that died inside it, so readers do not wait forever */
+static inline void board_writer_reset(board_shm_t* b, int writer)
+{
+    if (__atomic_load_n(&b->writers[writer].seq, __ATOMIC_ACQUIRE) & 1)
+        board_write_end(b, writer);
+}
+
+/* Records a change of ownership, called between board_write_begin and board_write_end */
+static inline void board_publish(board_shm_t* b, int writer, int old_owner, int new_owner)
+{
+    board_seq_t* w = &b->writers[writer];
+    if (old_owner != OWNER_NONE)
+        __atomic_store_n(&w->scores[old_owner], w->scores[old_owner] - 1, __ATOMIC_RELAXED);
+    if (new_owner != OWNER_NONE)
+        __atomic_store_n(&w->scores[new_owner], w->scores[new_owner] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&w->generation, w->generation + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Copies a consistent view of a published board
+ *
+ * @param words Buffer for owners_words(num_regions) words
+ * @param scores Buffer for MAX_OWNER_CODE + 1 scores
+ * @param generation Set to the generation of the copy
+ * @param attempts How many times to retry while writers are busy
+ * @return 1 on success, 0 if writers kept the board busy for every attempt
+ */
+int board_shm_snapshot(const board_shm_t* b, uint64_t* words, int32_t* scores, uint64_t* generation, int attempts)
+{
+    uint64_t seq[BOARD_WRITERS];
+    size_t n = owners_words(b->num_regions);
+    while (attempts-- > 0)
+    {
+        int busy = 0;
+        for (int w = 0; w < BOARD_WRITERS; w++)
+            busy |= (seq[w] = __atomic_load_n(&b->writers[w].seq, __ATOMIC_ACQUIRE)) & 1;
+        if (busy)
+        {
+            sched_yield();
+            continue;
+        }
+
+        *generation = 0;
+        for (int c = 0; c <= MAX_OWNER_CODE; c++)
+            scores[c] = 0;
+        for (int w = 0; w < BOARD_WRITERS; w++)
+        {
+            *generation += __atomic_load_n(&b->writers[w].generation, __ATOMIC_RELAXED);
+            for (int c = 0; c <= MAX_OWNER_CODE; c++)
+                scores[c] += __atomic_load_n(&b->writers[w].scores[c], __ATOMIC_RELAXED);
+        }
+        for (size_t i = 0; i < n; i++)
+            words[i] = __atomic_load_n(&b->words[i], __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        int changed = 0;
+        for (int w = 0; w < BOARD_WRITERS; w++)
+            changed |= __atomic_load_n(&b->writers[w].seq, __ATOMIC_RELAXED) != seq[w];
+        if (!changed)
+            return 1;
+    }
+    return 0;
+}
+
+#endif
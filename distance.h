@@ -0,0 +1,249 @@
+#ifndef DISTANCE_H
+#define DISTANCE_H
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "locks.h"
+#include "owners.h"
+#include "risk.h"
+
+#define DIST_INF (INT_MAX / 2)
+
+/**
+ * @struct distances
+ * @brief For every player, the number of moves from its territory to each region
+ *
+ * Owned regions are at 0, so a region at 1 is a legal move. The fields come from a multi-source
+ * BFS when the structure is created. After that they are only repaired where ownership changes:
+ *
+ *  - a claim by p can only bring regions closer to p. A BFS from the claimed region relaxes
+ *    just the regions that improve;
+ *  - a loss by p can push regions away from p. The regions whose every shortest path ran
+ *    through the lost region are found level by level, starting at the lost region. They are
+ *    reset, then filled in from their unaffected neighbors, smallest distance first.
+ *
+ * As with territory_t, updates come from the claim hook, keep their own copy of the owners and
+ * rebuild the fields from it when a holder of the mutex died. Strategies read the fields without
+ * the mutex, through dist_get(). Every entry is written with a relaxed atomic store, so a reader
+ * sees each distance either before or after an update, but a field as a whole may be half
+ * repaired.
+ */
+typedef struct distances
+{
+    pthread_mutex_t mutex;
+    int num_regions;
+    int players; /* Owner codes 1..players have a field */
+    const region_t* regions;
+    owners_t owners;
+    int* dist;  /* dist[p * num_regions + r] */
+    int* mark;  /* Affected-set stamps */
+    int* queue; /* Ring of regions whose distance dropped, also holds the affected set */
+    uint8_t* in_queue;
+    int* seeds; /* Affected regions sorted by their first estimate */
+    int stamp;
+} distances_t;
+
+static inline int* dist_field(distances_t* d, int p) { return &d->dist[p * d->num_regions]; }
+
+/* Only updates write the fields, under the mutex; readers do not take it */
+static inline void dist_put(int* dist, int r, int value) { __atomic_store_n(&dist[r], value, __ATOMIC_RELAXED); }
+
+/* Distance from player p's territory to region r, read without the mutex */
+static inline int dist_get(const distances_t* d, int p, int r)
+{
+    return __atomic_load_n(&d->dist[p * d->num_regions + r], __ATOMIC_RELAXED);
+}
+
+/* A region is queued at most once at a time, so the ring never holds more than num_regions */
+static inline void dist_push(distances_t* d, long* tail, int y)
+{
+    if (!d->in_queue[y])
+    {
+        d->in_queue[y] = 1;
+        d->queue[(*tail)++ % d->num_regions] = y;
+    }
+}
+
+static inline int dist_pop(distances_t* d, long* head)
+{
+    int x = d->queue[(*head)++ % d->num_regions];
+    d->in_queue[x] = 0;
+    return x;
+}
+
+/* Lowers the neighbors of x that are more than one step further, queueing them */
+static inline void dist_relax(distances_t* d, int* dist, int x, long* tail)
+{
+    const region_t* rx = &d->regions[x];
+    for (int k = 0; k < rx->num_neighbors; k++)
+    {
+        int y = rx->neighbors[k];
+        if (dist[y] > dist[x] + 1)
+        {
+            dist_put(dist, y, dist[x] + 1);
+            dist_push(d, tail, y);
+        }
+    }
+}
+
+static void dist_gain(distances_t* d, int r, int p)
+{
+    int* dist = dist_field(d, p);
+    long head = 0, tail = 0;
+    dist_put(dist, r, 0);
+    dist_push(d, &tail, r);
+    while (head < tail)
+        dist_relax(d, dist, dist_pop(d, &head), &tail);
+}
+
+static int cmp_seed_ctx_dist(const void* a, const void* b, void* ctx)
+{
+    const int* dist = ctx;
+    return (dist[*(const int*)a] > dist[*(const int*)b]) - (dist[*(const int*)a] < dist[*(const int*)b]);
+}
+
+/* r is no longer owned by p */
+static void dist_loss(distances_t* d, int r, int p)
+{
+    int* dist = dist_field(d, p);
+    int affected = d->stamp + 1, candidate = d->stamp + 2;
+    d->stamp += 2;
+
+    /* Level order: a candidate is affected if none of its neighbors one step closer survives */
+    int head = 0, tail = 0, num_affected = 0;
+    d->queue[tail++] = r;
+    d->mark[r] = candidate;
+    while (head < tail)
+    {
+        int x = d->queue[head++];
+        const region_t* rx = &d->regions[x];
+        if (x != r)
+        {
+            int supported = 0;
+            for (int k = 0; k < rx->num_neighbors && !supported; k++)
+            {
+                int z = rx->neighbors[k];
+                supported = dist[z] == dist[x] - 1 && d->mark[z] != affected;
+            }
+            if (supported)
+                continue;
+        }
+        d->mark[x] = affected;
+        d->seeds[num_affected++] = x;
+        for (int k = 0; k < rx->num_neighbors; k++)
+        {
+            int y = rx->neighbors[k];
+            if (dist[y] == dist[x] + 1 && d->mark[y] != candidate && d->mark[y] != affected)
+            {
+                d->mark[y] = candidate;
+                d->queue[tail++] = y;
+            }
+        }
+    }
+
+    /* First estimate of each affected region: one past its best unaffected neighbor */
+    for (int i = 0; i < num_affected; i++)
+    {
+        int x = d->seeds[i], best = DIST_INF;
+        const region_t* rx = &d->regions[x];
+        for (int k = 0; k < rx->num_neighbors; k++)
+        {
+            int z = rx->neighbors[k];
+            if (d->mark[z] != affected && dist[z] + 1 < best)
+                best = dist[z] + 1;
+        }
+        dist_put(dist, x, best);
+    }
+    qsort_r(d->seeds, num_affected, sizeof(int), cmp_seed_ctx_dist, dist);
+
+    /*
+     * Merge the sorted estimates with the BFS they start, smallest distance first. Lowering
+     * only ever touches affected regions, and any leftover ordering slack just costs a
+     * repeated relaxation.
+     */
+    long qhead = 0, qtail = 0;
+    for (int i = 0; i < num_affected || qhead < qtail;)
+    {
+        int x;
+        if (qhead < qtail &&
+            (i == num_affected || dist[d->queue[qhead % d->num_regions]] <= dist[d->seeds[i]]))
+            x = dist_pop(d, &qhead);
+        else if (dist[x = d->seeds[i++]] >= DIST_INF)
+            continue;
+        dist_relax(d, dist, x, &qtail);
+    }
+}
+
+/* Recomputes every field from the owners copy with one multi-source BFS per player */
+static void distances_rebuild(distances_t* d)
+{
+    memset(d->in_queue, 0, d->num_regions);
+    for (int p = 1; p <= d->players; p++)
+    {
+        int* dist = dist_field(d, p);
+        long head = 0, tail = 0;
+        for (int r = 0; r < d->num_regions; r++)
+            dist_put(dist, r, owner_get(&d->owners, r) == p ? 0 : DIST_INF);
+        for (int r = 0; r < d->num_regions; r++)
+            if (dist[r] == 0)
+                dist_push(d, &tail, r);
+        while (head < tail)
+            dist_relax(d, dist, dist_pop(d, &head), &tail);
+    }
+}
+
+/* Arena bytes taken by create_distances() */
+size_t distances_size(int num_regions, int players)
+{
+    return arena_round(sizeof(distances_t)) + arena_round(owners_words(num_regions) * sizeof(uint64_t)) +
+           arena_round(sizeof(int) * (players + 1) * num_regions) + 3 * arena_round(sizeof(int) * num_regions) +
+           arena_round(num_regions);
+}
+
+/**
+ * @brief Allocates distance fields for a board with no owned regions
+ *
+ * @param players Owner codes 1..players get a field
+ * @param arena Where the fields live
+ */
+distances_t* create_distances(const region_t* regions, int num_regions, int players, arena_t* arena)
+{
+    distances_t* d = arena_alloc(arena, sizeof(distances_t));
+    d->num_regions = num_regions;
+    d->players = players;
+    d->regions = regions;
+    d->owners.count = num_regions;
+    d->owners.words = arena_alloc(arena, owners_words(num_regions) * sizeof(uint64_t));
+    d->dist = arena_alloc(arena, sizeof(int) * (players + 1) * num_regions);
+    d->mark = arena_alloc(arena, sizeof(int) * num_regions);
+    d->queue = arena_alloc(arena, sizeof(int) * num_regions);
+    d->in_queue = arena_alloc(arena, num_regions);
+    d->seeds = arena_alloc(arena, sizeof(int) * num_regions);
+    for (long i = 0; i < (long)(players + 1) * num_regions; i++)
+        d->dist[i] = DIST_INF;
+    init_robust_mutex(&d->mutex, arena->shared);
+    return d;
+}
+
+void destroy_distances(distances_t* d) { pthread_mutex_destroy(&d->mutex); }
+
+/* Records that region r went to owner code code, the previous owner coming from the copy as in territory_update() */
+void distances_update(distances_t* d, int r, int prev, int code)
+{
+    if (lock_robust_mutex(&d->mutex))
+        distances_rebuild(d);
+    prev = owner_set(&d->owners, r, code);
+    if (prev != code)
+    {
+        if (prev >= 1 && prev <= d->players)
+            dist_loss(d, r, prev);
+        if (code >= 1 && code <= d->players)
+            dist_gain(d, r, code);
+    }
+    pthread_mutex_unlock(&d->mutex);
+}
+
+#endif
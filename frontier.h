@@ -0,0 +1,179 @@
+#ifndef FRONTIER_H
+#define FRONTIER_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "locks.h"
+#include "owners.h"
+#include "risk.h"
+
+/**
+ * @struct frontier
+ * @brief Counters telling at any time whether the game can go on
+ *
+ * For every player p and region r, adjacent[p][r] counts the neighbors of r owned by p. A move of p
+ * onto r is legal exactly when p does not own r and adjacent[p][r] > 0, and legal[p] counts those
+ * regions. An ownership change only touches the changed region and its neighbors, so every update
+ * costs O(degree). A region next to the territories of two or more players is contested.
+ *
+ * As with territory_t, the structure keeps its own copy of the owners, changes only through
+ * frontier_update() and is recounted from the copy when a holder of the mutex died. The
+ * counters can be read without the mutex.
+ */
+typedef struct frontier
+{
+    pthread_mutex_t mutex;
+    int num_regions;
+    int players; /* Owner codes 1..players are tracked */
+    const region_t* regions;
+    owners_t owners;
+    int* adjacent; /* adjacent[p * num_regions + r] */
+    int unowned;
+    int legal[MAX_OWNER_CODE + 1];
+    int contested;
+} frontier_t;
+
+static inline int* frontier_adjacent(frontier_t* f, int p, int r) { return &f->adjacent[p * f->num_regions + r]; }
+
+/* 1 if p could move onto r */
+static inline int frontier_legal_at(frontier_t* f, int p, int r)
+{
+    return owner_get(&f->owners, r) != p && *frontier_adjacent(f, p, r) > 0;
+}
+
+static inline int frontier_contested_at(frontier_t* f, int r)
+{
+    int players = 0;
+    for (int p = 1; p <= f->players; p++)
+        players += *frontier_adjacent(f, p, r) > 0;
+    return players >= 2;
+}
+
+/* Arena bytes taken by create_frontier() */
+size_t frontier_size(int num_regions, int players)
+{
+    return arena_round(sizeof(frontier_t)) + arena_round(owners_words(num_regions) * sizeof(uint64_t)) +
+           arena_round(sizeof(int) * (players + 1) * num_regions);
+}
+
+/**
+ * @brief Allocates counters for a board with no owned regions
+ *
+ * @param players Owner codes 1..players are tracked
+ * @param arena Where the counters live
+ */
+frontier_t* create_frontier(const region_t* regions, int num_regions, int players, arena_t* arena)
+{
+    frontier_t* f = arena_alloc(arena, sizeof(frontier_t));
+    f->num_regions = num_regions;
+    f->players = players;
+    f->regions = regions;
+    f->owners.count = num_regions;
+    f->owners.words = arena_alloc(arena, owners_words(num_regions) * sizeof(uint64_t));
+    f->adjacent = arena_alloc(arena, sizeof(int) * (players + 1) * num_regions);
+    f->unowned = num_regions;
+    init_robust_mutex(&f->mutex, arena->shared);
+    return f;
+}
+
+void destroy_frontier(frontier_t* f) { pthread_mutex_destroy(&f->mutex); }
+
+/* Recounts everything from the owners copy */
+static void frontier_rebuild(frontier_t* f)
+{
+    memset(f->adjacent, 0, sizeof(int) * (f->players + 1) * f->num_regions);
+    int unowned = 0;
+    for (int r = 0; r < f->num_regions; r++)
+    {
+        int code = owner_get(&f->owners, r);
+        unowned += code == OWNER_NONE;
+        if (code >= 1 && code <= f->players)
+            for (int k = 0; k < f->regions[r].num_neighbors; k++)
+                (*frontier_adjacent(f, code, f->regions[r].neighbors[k]))++;
+    }
+    __atomic_store_n(&f->unowned, unowned, __ATOMIC_RELAXED);
+
+    int contested = 0;
+    for (int r = 0; r < f->num_regions; r++)
+        contested += frontier_contested_at(f, r);
+    __atomic_store_n(&f->contested, contested, __ATOMIC_RELAXED);
+    for (int p = 1; p <= f->players; p++)
+    {
+        int legal = 0;
+        for (int r = 0; r < f->num_regions; r++)
+            legal += frontier_legal_at(f, p, r);
+        __atomic_store_n(&f->legal[p], legal, __ATOMIC_RELAXED);
+    }
+}
+
+/* Records that region r went to owner code code, the previous owner coming from the copy as in territory_update() */
+void frontier_update(frontier_t* f, int r, int prev, int code)
+{
+    const region_t* reg = &f->regions[r];
+
+    /* The regions whose legality can change: r and its neighbors, without repeats */
+    int touched[MAX_NEIGHBORS + 1], count = 0;
+    touched[count++] = r;
+    for (int k = 0; k < reg->num_neighbors; k++)
+    {
+        int y = reg->neighbors[k], seen = 0;
+        for (int i = 0; i < count && !seen; i++)
+            seen = touched[i] == y;
+        if (!seen)
+            touched[count++] = y;
+    }
+
+    if (lock_robust_mutex(&f->mutex))
+        frontier_rebuild(f);
+    prev = owner_get(&f->owners, r);
+    if (prev == code)
+    {
+        pthread_mutex_unlock(&f->mutex);
+        return;
+    }
+    /*
+     * Readers act on legal[p] dropping to zero, so every counter moves once, by its net change,
+     * never through an intermediate value.
+     */
+    int ps[] = {prev, code}, legal[2] = {0, 0}, contested = 0;
+    for (int j = 0; j < 2; j++)
+        if (ps[j] >= 1 && ps[j] <= f->players)
+            for (int i = 0; i < count; i++)
+                legal[j] -= frontier_legal_at(f, ps[j], touched[i]);
+    for (int i = 0; i < count; i++)
+        contested -= frontier_contested_at(f, touched[i]);
+
+    owner_set(&f->owners, r, code);
+    for (int k = 0; k < reg->num_neighbors; k++)
+    {
+        if (prev >= 1 && prev <= f->players)
+            (*frontier_adjacent(f, prev, reg->neighbors[k]))--;
+        if (code >= 1 && code <= f->players)
+            (*frontier_adjacent(f, code, reg->neighbors[k]))++;
+    }
+
+    for (int j = 0; j < 2; j++)
+        if (ps[j] >= 1 && ps[j] <= f->players)
+        {
+            for (int i = 0; i < count; i++)
+                legal[j] += frontier_legal_at(f, ps[j], touched[i]);
+            __atomic_fetch_add(&f->legal[ps[j]], legal[j], __ATOMIC_RELAXED);
+        }
+    for (int i = 0; i < count; i++)
+        contested += frontier_contested_at(f, touched[i]);
+    __atomic_fetch_add(&f->contested, contested, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&f->unowned, (code == OWNER_NONE) - (prev == OWNER_NONE), __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&f->mutex);
+}
+
+/* Number of regions player p can legally move onto */
+static inline int frontier_legal(frontier_t* f, int p) { return __atomic_load_n(&f->legal[p], __ATOMIC_RELAXED); }
+
+static inline int frontier_unowned(frontier_t* f) { return __atomic_load_n(&f->unowned, __ATOMIC_RELAXED); }
+
+/* Number of regions next to two or more players */
+static inline int frontier_contested(frontier_t* f) { return __atomic_load_n(&f->contested, __ATOMIC_RELAXED); }
+
+#endif
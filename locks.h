@@ -0,0 +1,297 @@
+#ifndef LOCKS_H
+#define LOCKS_H
+
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "risk.h"
+
+/*
+ * Region lock layouts, selected at compile time with -DLOCK_MODE=...
+ *
+ * LOCK_MUTEX   one pthread_mutex_t per region (the original layout, 40 bytes per region)
+ * LOCK_STRIPED region IDs hashed into a power-of-two table of LOCK_STRIPES mutexes
+ * LOCK_SPIN    one 1-byte spinlock per region, in an array of its own
+ */
+#define LOCK_MUTEX 0
+#define LOCK_STRIPED 1
+#define LOCK_SPIN 2
+
+#ifndef LOCK_MODE
+#define LOCK_MODE LOCK_STRIPED
+#endif
+
+#ifndef LOCK_STRIPES
+#define LOCK_STRIPES 256 /* Upper bound on the stripe table, must be a power of two */
+#endif
+
+#if LOCK_STRIPES & (LOCK_STRIPES - 1)
+#error "LOCK_STRIPES must be a power of two"
+#endif
+
+/* Largest lock set a single move can take: the region plus all its neighbors */
+#define MAX_LOCK_SET (MAX_NEIGHBORS + 1)
+
+/**
+ * @struct region_locks
+ * @brief Lock table guarding the owners of a board
+ *
+ * Callers never index the table directly: region IDs are turned into lock keys by
+ * lock_set(), and every key set is acquired in ascending order, so moves, single
+ * region updates and whole-board snapshots can never deadlock each other.
+ */
+typedef struct region_locks
+{
+#if LOCK_MODE == LOCK_SPIN
+    int8_t* spins; /* One spinlock byte per region */
+#else
+    pthread_mutex_t* mutexes;
+    int mask;    /* Stripe index mask, count - 1 (unused by LOCK_MUTEX) */
+    int pshared; /* Mutexes live in a shared arena and work across fork() */
+#endif
+    int in_arena; /* Otherwise malloc()ed by init_region_locks */
+    int count;    /* Number of independent locks */
+} region_locks_t;
+
+static inline int lock_key(const region_locks_t* l, int id)
+{
+#if LOCK_MODE == LOCK_STRIPED
+    return id & l->mask;
+#else
+    return id;
+#endif
+}
+
+/**
+ * @brief Initializes a mutex that player processes may share
+ *
+ * With shared set, the mutex is PTHREAD_PROCESS_SHARED and robust: when its holder dies, the
+ * next lock_robust_mutex() still gets it and learns that the state it guards may be half
+ * updated.
+ */
+void init_robust_mutex(pthread_mutex_t* m, int shared)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    if (shared && (pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) ||
+                   pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST)))
+        ERR("pthread_mutexattr");
+    if (pthread_mutex_init(m, &attr))
+        ERR("pthread_mutex_init");
+    pthread_mutexattr_destroy(&attr);
+}
+
+/* Locks m; returns 1 if its previous holder died while holding it, so the guarded state has to be repaired */
+static inline int lock_robust_mutex(pthread_mutex_t* m)
+{
+    int err = pthread_mutex_lock(m);
+    if (err == EOWNERDEAD)
+    {
+        pthread_mutex_consistent(m);
+        return 1;
+    }
+    if (err)
+        errno = err, ERR("pthread_mutex_lock");
+    return 0;
+}
+
+#if LOCK_MODE == LOCK_SPIN
+static inline void spin_lock(int8_t* lock)
+{
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE))
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED))
+            sched_yield();
+}
+
+static inline void spin_unlock(int8_t* lock) { __atomic_store_n(lock, 0, __ATOMIC_RELEASE); }
+#else
+/*
+ * A player that died holding region locks changed at most one owner, with a single CAS, so the
+ * owner words need no repair. The rest of its claim is repaired elsewhere: the supervisor
+ * closes its board write section, and each tracker it died in rebuilds itself behind its own
+ * robust mutex. A claim whose hook never ran is caught up with when the region next changes.
+ */
+static inline void robust_lock(pthread_mutex_t* m) { lock_robust_mutex(m); }
+#endif
+
+/* Number of independent locks for a board */
+static inline int region_lock_count(int num_regions)
+{
+#if LOCK_MODE == LOCK_STRIPED
+    /* No point in more stripes than regions */
+    int count = 1;
+    while (count < LOCK_STRIPES && count < num_regions)
+        count <<= 1;
+    return count;
+#else
+    return num_regions;
+#endif
+}
+
+/* Arena bytes taken by init_region_locks() */
+size_t region_locks_arena_size(int num_regions)
+{
+#if LOCK_MODE == LOCK_SPIN
+    return arena_round(sizeof(int8_t) * region_lock_count(num_regions));
+#else
+    return arena_round(sizeof(pthread_mutex_t) * region_lock_count(num_regions));
+#endif
+}
+
+/**
+ * @brief Sets up the lock table for a board
+ *
+ * With a shared arena the table can be used by processes forked afterwards: mutexes are
+ * PTHREAD_PROCESS_SHARED and robust, so a player process dying inside a move does not leave
+ * its locks held forever. With LOCK_SPIN a lock held by a dead process stays held.
+ *
+ * @param l The table to initialize
+ * @param num_regions The number of regions on the board
+ * @param arena Where the mutexes or spinlocks go, NULL to malloc() them
+ */
+void init_region_locks(region_locks_t* l, int num_regions, arena_t* arena)
+{
+    l->count = region_lock_count(num_regions);
+    l->in_arena = arena != NULL;
+#if LOCK_MODE == LOCK_SPIN
+    if (arena)
+        l->spins = arena_alloc(arena, sizeof(int8_t) * l->count);
+    else if (!(l->spins = calloc(l->count ? l->count : 1, sizeof(int8_t))))
+        ERR("calloc");
+#else
+    l->mask = LOCK_MODE == LOCK_STRIPED ? l->count - 1 : 0;
+    l->pshared = arena && arena->shared;
+    if (arena)
+        l->mutexes = arena_alloc(arena, sizeof(pthread_mutex_t) * l->count);
+    else if (!(l->mutexes = malloc(sizeof(pthread_mutex_t) * l->count)))
+        ERR("malloc");
+    for (int i = 0; i < l->count; i++)
+        init_robust_mutex(&l->mutexes[i], l->pshared);
+#endif
+}
+
+void destroy_region_locks(region_locks_t* l)
+{
+#if LOCK_MODE == LOCK_SPIN
+    if (!l->in_arena)
+        free(l->spins);
+    l->spins = NULL;
+#else
+    for (int i = 0; i < l->count; i++)
+        pthread_mutex_destroy(&l->mutexes[i]);
+    if (!l->in_arena)
+        free(l->mutexes);
+    l->mutexes = NULL;
+#endif
+}
+
+/* Bytes spent on locking, on top of the board itself */
+size_t region_locks_size(const region_locks_t* l)
+{
+#if LOCK_MODE == LOCK_SPIN
+    return (size_t)l->count * sizeof(l->spins[0]);
+#else
+    return (size_t)l->count * sizeof(pthread_mutex_t);
+#endif
+}
+
+#define CMP_SWAP(a, b)     \
+    do                     \
+    {                      \
+        if (k[b] < k[a])   \
+        {                  \
+            int t_ = k[a]; \
+            k[a] = k[b];   \
+            k[b] = t_;     \
+        }                  \
+    } while (0)
+
+/* Batcher's odd-even merge network for 8 inputs, 19 comparators */
+static inline void sort8(int* k)
+{
+    CMP_SWAP(0, 1); CMP_SWAP(2, 3); CMP_SWAP(4, 5); CMP_SWAP(6, 7);
+    CMP_SWAP(0, 2); CMP_SWAP(1, 3); CMP_SWAP(4, 6); CMP_SWAP(5, 7);
+    CMP_SWAP(1, 2); CMP_SWAP(5, 6);
+    CMP_SWAP(0, 4); CMP_SWAP(1, 5); CMP_SWAP(2, 6); CMP_SWAP(3, 7);
+    CMP_SWAP(2, 4); CMP_SWAP(3, 5);
+    CMP_SWAP(1, 2); CMP_SWAP(3, 4); CMP_SWAP(5, 6);
+}
+
+#undef CMP_SWAP
+
+_Static_assert(MAX_LOCK_SET <= 8, "lock_set() sorts keys with an 8-input network");
+
+/**
+ * @brief Turns a set of region IDs into an ordered, duplicate-free set of lock keys
+ *
+ * @param l The lock table
+ * @param ids Region IDs, at most MAX_LOCK_SET of them
+ * @param cnt The number of IDs
+ * @param keys Output buffer with room for MAX_LOCK_SET keys
+ * @return The number of keys to pass to lock_regions/unlock_regions
+ */
+int lock_set(const region_locks_t* l, const int* ids, int cnt, int* keys)
+{
+    int k[8];
+    for (int i = 0; i < 8; i++)
+        k[i] = i < cnt ? lock_key(l, ids[i]) : INT_MAX;
+    sort8(k);
+
+    int n = 0;
+    for (int i = 0; i < cnt; i++)
+        if (n == 0 || keys[n - 1] != k[i])
+            keys[n++] = k[i];
+    return n;
+}
+
+/* Lock key set in ascending order (deadlock-free) */
+void lock_regions(const region_locks_t* l, const int* keys, int cnt)
+{
+    for (int i = 0; i < cnt; i++)
+#if LOCK_MODE == LOCK_SPIN
+        spin_lock(&l->spins[keys[i]]);
+#else
+        robust_lock(&l->mutexes[keys[i]]);
+#endif
+}
+
+void unlock_regions(const region_locks_t* l, const int* keys, int cnt)
+{
+    for (int i = cnt - 1; i >= 0; i--)
+#if LOCK_MODE == LOCK_SPIN
+        spin_unlock(&l->spins[keys[i]]);
+#else
+        pthread_mutex_unlock(&l->mutexes[keys[i]]);
+#endif
+}
+
+void lock_region(const region_locks_t* l, int id)
+{
+    int key = lock_key(l, id);
+    lock_regions(l, &key, 1);
+}
+
+void unlock_region(const region_locks_t* l, int id)
+{
+    int key = lock_key(l, id);
+    unlock_regions(l, &key, 1);
+}
+
+/* Lock every key, e.g. to print a consistent board */
+void lock_all_regions(const region_locks_t* l)
+{
+    for (int i = 0; i < l->count; i++)
+        lock_regions(l, &i, 1);
+}
+
+void unlock_all_regions(const region_locks_t* l)
+{
+    for (int i = l->count - 1; i >= 0; i--)
+        unlock_regions(l, &i, 1);
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "risk.h"
+
+#ifndef METRICS_RING
+#define METRICS_RING 4096 /* Samples kept, older ones are overwritten */
+#endif
+
+#define METRICS_PLAYERS 2
+
+/**
+ * @struct metrics_sample
+ * @brief State of a game at one point in time
+ */
+typedef struct metrics_sample
+{
+    double t; /* Seconds since the game started */
+    int score[METRICS_PLAYERS];
+    double claims_per_s[METRICS_PLAYERS];
+    double rejected_per_s[METRICS_PLAYERS];
+    int contested; /* Regions next to both players' territories */
+} metrics_sample_t;
+
+/**
+ * @struct metrics
+ * @brief Ring of the latest samples of a game
+ *
+ * Only the sampling thread touches it. The inputs are counters the players and the claim hook
+ * already keep, so taking a sample never locks the board.
+ */
+typedef struct metrics
+{
+    metrics_sample_t* samples;
+    size_t capacity;
+    size_t taken; /* Samples recorded so far, the ring holds the last capacity of them */
+    double last_t;
+    long last_claims[METRICS_PLAYERS];
+    long last_rejected[METRICS_PLAYERS];
+} metrics_t;
+
+/* Arena bytes taken by init_metrics() */
+static inline size_t metrics_size(size_t capacity) { return arena_round(sizeof(metrics_sample_t) * capacity); }
+
+void init_metrics(metrics_t* m, size_t capacity, arena_t* arena)
+{
+    memset(m, 0, sizeof(*m));
+    m->capacity = capacity;
+    m->samples = arena_alloc(arena, sizeof(metrics_sample_t) * capacity);
+}
+
+/**
+ * @brief Appends a sample, turning the running counters into rates since the previous sample
+ *
+ * @param t Seconds since the game started
+ * @param score Points of every player
+ * @param claims Successful moves of every player so far
+ * @param rejected Illegal moves of every player so far
+ * @param contested Regions next to both players' territories
+ */
+void metrics_record(metrics_t* m, double t, const int* score, const long* claims, const long* rejected, int contested)
+{
+    metrics_sample_t* s = &m->samples[m->taken++ % m->capacity];
+    double dt = t - m->last_t;
+    s->t = t;
+    s->contested = contested;
+    for (int p = 0; p < METRICS_PLAYERS; p++)
+    {
+        s->score[p] = score[p];
+        s->claims_per_s[p] = dt > 0 ? (claims[p] - m->last_claims[p]) / dt : 0;
+        s->rejected_per_s[p] = dt > 0 ? (rejected[p] - m->last_rejected[p]) / dt : 0;
+        m->last_claims[p] = claims[p];
+        m->last_rejected[p] = rejected[p];
+    }
+    m->last_t = t;
+}
+
+/* Samples lost because the ring wrapped around */
+static inline size_t metrics_dropped(const metrics_t* m) { return m->taken > m->capacity ? m->taken - m->capacity : 0; }
+
+/**
+ * @brief Writes the ring, oldest sample first
+ *
+ * A path ending in .csv gets CSV with a header line, anything else gets one JSON object per line.
+ * Every sample is tagged with the game number; game 0 starts the file, later games append to it.
+ *
+ * @param names One character per player, used in column and key names
+ * @param game Number of the game in a series
+ */
+void write_metrics(const metrics_t* m, const char* path, const char* names, int game)
+{
+    FILE* f = fopen(path, game ? "a" : "w");
+    if (!f)
+        ERR("fopen");
+    size_t len = strlen(path);
+    int csv = len >= 4 && !strcmp(path + len - 4, ".csv");
+
+    if (csv && !game)
+    {
+        fprintf(f, "game,t");
+        for (int p = 0; p < METRICS_PLAYERS; p++)
+            fprintf(f, ",score_%c,claims_per_s_%c,rejected_per_s_%c", names[p], names[p], names[p]);
+        fprintf(f, ",contested\n");
+    }
+    for (size_t i = metrics_dropped(m); i < m->taken; i++)
+    {
+        const metrics_sample_t* s = &m->samples[i % m->capacity];
+        if (csv)
+        {
+            fprintf(f, "%d,%.3f", game, s->t);
+            for (int p = 0; p < METRICS_PLAYERS; p++)
+                fprintf(f, ",%d,%.1f,%.1f", s->score[p], s->claims_per_s[p], s->rejected_per_s[p]);
+            fprintf(f, ",%d\n", s->contested);
+        }
+        else
+        {
+            fprintf(f, "{\"game\":%d,\"t\":%.3f", game, s->t);
+            for (int p = 0; p < METRICS_PLAYERS; p++)
+                fprintf(f, ",\"%c\":{\"score\":%d,\"claims_per_s\":%.1f,\"rejected_per_s\":%.1f}", names[p],
+                        s->score[p], s->claims_per_s[p], s->rejected_per_s[p]);
+            fprintf(f, ",\"contested\":%d}\n", s->contested);
+        }
+    }
+    if (fclose(f))
+        ERR("fclose");
+}
+
+#endif
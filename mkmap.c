@@ -0,0 +1,43 @@
+#include "risk.h"
+
+/*
+ * Writes a width x height torus board to stdout, in the format of
+ * maps/torus.risk: every region has its four grid neighbors, wrapping around
+ * at the edges, listed in ascending order.
+ */
+
+void usage(int argc, char** argv)
+{
+    fprintf(stderr, "USAGE: %s width height > board.risk\n", argv[0]);
+    exit(EXIT_FAILURE);
+}
+
+int cmp_int(const void *a, const void *b)
+{
+    return (*(const int *)a > *(const int *)b) - (*(const int *)a < *(const int *)b);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+        usage(argc, argv);
+    long width = atol(argv[1]), height = atol(argv[2]);
+    if (width < 3 || height < 3 || width * height > INT32_MAX)
+        usage(argc, argv);
+
+    for (long y = 0; y < height; y++) {
+        for (long x = 0; x < width; x++) {
+            int n[4] = {
+                y * width + (x + width - 1) % width,
+                y * width + (x + 1) % width,
+                (y + height - 1) % height * width + x,
+                (y + 1) % height * width + x
+            };
+            qsort(n, 4, sizeof(int), cmp_int);
+            printf("%d;%d;%d;%d\n", n[0], n[1], n[2], n[3]);
+        }
+    }
+    if (fflush(stdout) == EOF)
+        ERR("fflush");
+    return 0;
+}
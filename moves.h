@@ -0,0 +1,188 @@
+#ifndef MOVES_H
+#define MOVES_H
+
+#include "board_shm.h"
+#include "locks.h"
+#include "owners.h"
+#include "risk.h"
+
+/**
+ * @struct claim_hook
+ * @brief Observer of ownership changes
+ *
+ * Called with the lock set of the changed region still held, so hooks see the changes of any
+ * region in the same order as they happened.
+ */
+typedef struct claim_hook
+{
+    void (*fn)(void* ctx, int r, int prev, int code);
+    void* ctx;
+} claim_hook_t;
+
+static inline void notify_claim(const claim_hook_t* hook, int r, int prev, int code)
+{
+    if (hook)
+        hook->fn(hook->ctx, r, prev, code);
+}
+
+/**
+ * @brief Attempts to claim a region for a player
+ *
+ * Locks the region and its neighbors, and claims the region if the player does not own it yet
+ * and owns at least one of its neighbors. Only a claim opens a write section on the published
+ * board, so rejected moves never make viewers retry.
+ *
+ * @param board The published board, writer slot me
+ * @param hook Notified of a successful claim, may be NULL
+ * @param me The player's owner code
+ * @return The previous owner code of the region if the claim succeeded, -1 if the move was illegal
+ */
+typedef int (*move_fn)(const region_t* regions, owners_t* owners, board_shm_t* board, const region_locks_t* l,
+                       const claim_hook_t* hook, int r, int me);
+
+/* Generic kernel, walks the region's own neighbor count */
+int try_move(const region_t* regions, owners_t* owners, board_shm_t* board, const region_locks_t* l,
+             const claim_hook_t* hook, int r, int me)
+{
+    const region_t* reg = &regions[r];
+    int ids[MAX_LOCK_SET], keys[MAX_LOCK_SET];
+    ids[0] = r;
+    for (int i = 0; i < reg->num_neighbors; i++)
+        ids[i + 1] = reg->neighbors[i];
+    int count = lock_set(l, ids, 1 + reg->num_neighbors, keys);
+
+    lock_regions(l, keys, count);
+    int prev = -1;
+    int owner = owner_get(owners, r);
+    if (owner != me)
+        for (int i = 0; i < reg->num_neighbors; i++)
+            if (owner_get(owners, reg->neighbors[i]) == me)
+            {
+                board_write_begin(board, me);
+                owner_cas(owners, r, owner, me);
+                board_publish(board, me, owner, me);
+                board_write_end(board, me);
+                notify_claim(hook, r, owner, me);
+                prev = owner;
+                break;
+            }
+    unlock_regions(l, keys, count);
+    return prev;
+}
+
+/*
+ * Kernels specialized for a fixed degree D. The trip counts are compile-time constants, so the
+ * lock set construction and the legality check unroll into straight-line code without any
+ * branch on the neighbor count. They read D neighbor slots of every region, which is why
+ * the board has to go through pad_neighbors() first.
+ */
+#define DEFINE_MOVE_KERNEL(D)                                                                                \
+    int try_move_##D(const region_t* regions, owners_t* owners, board_shm_t* board, const region_locks_t* l, \
+                     const claim_hook_t* hook, int r, int me)                                                \
+    {                                                                                                        \
+        const region_t* reg = &regions[r];                                                                   \
+        int ids[MAX_LOCK_SET], keys[MAX_LOCK_SET];                                                           \
+        ids[0] = r;                                                                                          \
+        _Pragma("GCC unroll 6") for (int i = 0; i < D; i++)                                                  \
+            ids[i + 1] = reg->neighbors[i];                                                                  \
+        int count = lock_set(l, ids, 1 + D, keys);                                                           \
+                                                                                                             \
+        lock_regions(l, keys, count);                                                                        \
+        int legal = 0;                                                                                       \
+        _Pragma("GCC unroll 6") for (int i = 0; i < D; i++)                                                  \
+            legal |= owner_get(owners, reg->neighbors[i]) == me;                                             \
+        int prev = -1;                                                                                       \
+        int owner = owner_get(owners, r);                                                                    \
+        if (legal && owner != me)                                                                            \
+        {                                                                                                    \
+            board_write_begin(board, me);                                                                    \
+            owner_cas(owners, r, owner, me);                                                                 \
+            board_publish(board, me, owner, me);                                                             \
+            board_write_end(board, me);                                                                      \
+            notify_claim(hook, r, owner, me);                                                                \
+            prev = owner;                                                                                    \
+        }                                                                                                    \
+        unlock_regions(l, keys, count);                                                                      \
+        return prev;                                                                                         \
+    }
+
+DEFINE_MOVE_KERNEL(2)
+DEFINE_MOVE_KERNEL(3)
+DEFINE_MOVE_KERNEL(4)
+DEFINE_MOVE_KERNEL(6)
+
+#undef DEFINE_MOVE_KERNEL
+
+/**
+ * @brief Finds the largest neighbor count on a board
+ *
+ * @param uniform Set to 1 if every region has exactly that many neighbors, 0 otherwise
+ */
+int board_degree(const region_t* regions, int num_regions, int* uniform)
+{
+    int max = 0;
+    *uniform = 1;
+    for (int i = 0; i < num_regions; i++)
+    {
+        if (i > 0 && regions[i].num_neighbors != max)
+            *uniform = 0;
+        if (regions[i].num_neighbors > max)
+            max = regions[i].num_neighbors;
+    }
+    return max;
+}
+
+/* The smallest specialized kernel degree covering max_degree, 0 if only the generic one does */
+int kernel_degree(int max_degree)
+{
+    if (max_degree <= 2)
+        return 2;
+    if (max_degree <= 4)
+        return max_degree;
+    if (max_degree <= 6)
+        return 6;
+    return 0;
+}
+
+/**
+ * @brief Fills unused neighbor slots up to degree with the region's own index
+ *
+ * A region is never its own legal source (a move on a region the player already owns is
+ * illegal) and its lock is taken anyway, so the padding changes neither the rules nor the
+ * lock set. num_neighbors keeps the real count for printing.
+ */
+void pad_neighbors(region_t* regions, int num_regions, int degree)
+{
+    for (int i = 0; i < num_regions; i++)
+        for (int j = regions[i].num_neighbors; j < degree; j++)
+            regions[i].neighbors[j] = i;
+}
+
+/**
+ * @brief Picks the move kernel for a board, padding it if needed
+ *
+ * Called once per game; player threads then go through the returned pointer for every move.
+ */
+move_fn select_move_kernel(region_t* regions, int num_regions)
+{
+    int uniform;
+    int max = board_degree(regions, num_regions, &uniform);
+    int degree = kernel_degree(max);
+    if (degree && (!uniform || degree != max))
+        pad_neighbors(regions, num_regions, degree);
+    switch (degree)
+    {
+        case 2:
+            return try_move_2;
+        case 3:
+            return try_move_3;
+        case 4:
+            return try_move_4;
+        case 6:
+            return try_move_6;
+        default:
+            return try_move;
+    }
+}
+
+#endif
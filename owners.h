@@ -0,0 +1,183 @@
+#ifndef OWNERS_H
+#define OWNERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "risk.h"
+
+/*
+ * Packed region ownership. Every region takes OWNER_BITS bits of a 64-bit word:
+ * code 0 means unowned ('-'), codes 1.. are players 'A', 'B', ...
+ *
+ * OWNER_BITS=2 fits up to 3 players, OWNER_BITS=4 up to 15.
+ */
+#ifndef OWNER_BITS
+#define OWNER_BITS 2
+#endif
+
+#if OWNER_BITS != 2 && OWNER_BITS != 4
+#error "OWNER_BITS must be 2 or 4"
+#endif
+
+#define OWNERS_PER_WORD (64 / OWNER_BITS)
+#define OWNER_MASK ((UINT64_C(1) << OWNER_BITS) - 1)
+#define MAX_OWNER_CODE ((int)OWNER_MASK)
+#define OWNER_NONE 0
+
+/* Symbol printed for each owner code */
+static const char owner_symbols[] = "-ABCDEFGHIJKLMNO";
+
+/* Every field of a word set to the low bit only, e.g. 0x5555... for 2-bit fields */
+#define OWNER_LOW_BITS (UINT64_MAX / OWNER_MASK)
+
+/**
+ * @struct owners
+ * @brief Owner codes of all regions of a board
+ *
+ * Fields sharing a word are guarded by different region locks, so every write is an atomic
+ * read-modify-write of the whole word. Reads are relaxed atomic loads; callers that need a
+ * stable value hold the region's lock.
+ */
+typedef struct owners
+{
+    uint64_t* words;
+    size_t count; /* Number of regions */
+} owners_t;
+
+static inline size_t owners_words(size_t count) { return (count + OWNERS_PER_WORD - 1) / OWNERS_PER_WORD; }
+
+/* Allocates an all-unowned array for count regions */
+void init_owners(owners_t* o, size_t count)
+{
+    o->count = count;
+    o->words = calloc(owners_words(count) ? owners_words(count) : 1, sizeof(uint64_t));
+    if (!o->words)
+        ERR("calloc");
+}
+
+void destroy_owners(owners_t* o)
+{
+    free(o->words);
+    o->words = NULL;
+}
+
+static inline int owner_get(const owners_t* o, size_t i)
+{
+    uint64_t w = __atomic_load_n(&o->words[i / OWNERS_PER_WORD], __ATOMIC_RELAXED);
+    return (int)((w >> (i % OWNERS_PER_WORD * OWNER_BITS)) & OWNER_MASK);
+}
+
+/**
+ * @brief Sets the owner of region i to code if it currently is expected
+ *
+ * @return 1 if the field was changed, 0 if it held something other than expected
+ */
+static inline int owner_cas(owners_t* o, size_t i, int expected, int code)
+{
+    uint64_t* word = &o->words[i / OWNERS_PER_WORD];
+    int shift = i % OWNERS_PER_WORD * OWNER_BITS;
+    uint64_t w = __atomic_load_n(word, __ATOMIC_RELAXED);
+    do
+    {
+        if ((int)((w >> shift) & OWNER_MASK) != expected)
+            return 0;
+    } while (!__atomic_compare_exchange_n(word, &w, (w & ~(OWNER_MASK << shift)) | ((uint64_t)code << shift),
+                                          1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return 1;
+}
+
+/* Unconditionally sets the owner of region i, returns the previous code */
+static inline int owner_set(owners_t* o, size_t i, int code)
+{
+    uint64_t* word = &o->words[i / OWNERS_PER_WORD];
+    int shift = i % OWNERS_PER_WORD * OWNER_BITS;
+    uint64_t w = __atomic_load_n(word, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(word, &w, (w & ~(OWNER_MASK << shift)) | ((uint64_t)code << shift), 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    return (int)((w >> shift) & OWNER_MASK);
+}
+
+/**
+ * @brief Decodes the owners of regions [start, start + n) into their symbols
+ *
+ * Works a word at a time, for rendering large boards without a call per region.
+ */
+void owners_decode(const owners_t* o, size_t start, size_t n, char* out)
+{
+    size_t i = start, end = start + n;
+    while (i < end)
+    {
+        uint64_t w = __atomic_load_n(&o->words[i / OWNERS_PER_WORD], __ATOMIC_RELAXED);
+        size_t field = i % OWNERS_PER_WORD;
+        w >>= field * OWNER_BITS;
+        for (; field < OWNERS_PER_WORD && i < end; field++, i++, w >>= OWNER_BITS)
+            *out++ = owner_symbols[w & OWNER_MASK];
+    }
+}
+
+/* A word with a 1 in the low bit of every field equal to zero */
+static inline uint64_t zero_fields(uint64_t x)
+{
+#if OWNER_BITS == 4
+    x |= x >> 2;
+#endif
+    x |= x >> 1;
+    return ~x & OWNER_LOW_BITS;
+}
+
+/**
+ * @brief Counts the regions held by every owner code
+ *
+ * Uses a popcount per code and word instead of decoding fields one by one.
+ *
+ * @param counts Array of MAX_OWNER_CODE + 1 counters, overwritten
+ */
+void owners_count(const owners_t* o, size_t counts[MAX_OWNER_CODE + 1])
+{
+    for (int c = 0; c <= MAX_OWNER_CODE; c++)
+        counts[c] = 0;
+    size_t words = owners_words(o->count);
+    for (size_t wi = 0; wi < words; wi++)
+    {
+        uint64_t w = __atomic_load_n(&o->words[wi], __ATOMIC_RELAXED);
+        size_t left = OWNERS_PER_WORD;
+        for (int c = 1; c <= MAX_OWNER_CODE && w; c++)
+        {
+            size_t k = __builtin_popcountll(zero_fields(w ^ (OWNER_LOW_BITS * c)));
+            counts[c] += k;
+            left -= k;
+        }
+        counts[OWNER_NONE] += left;
+    }
+    /* The unused tail of the last word reads as unowned */
+    counts[OWNER_NONE] -= words * OWNERS_PER_WORD - o->count;
+}
+
+/**
+ * @brief Finds the k-th owned region in index order
+ *
+ * @return Its index, or -1 if fewer than k + 1 regions are owned
+ */
+long owners_find_owned(const owners_t* o, size_t k)
+{
+    size_t words = owners_words(o->count);
+    for (size_t wi = 0; wi < words; wi++)
+    {
+        uint64_t owned = ~zero_fields(__atomic_load_n(&o->words[wi], __ATOMIC_RELAXED)) & OWNER_LOW_BITS;
+        size_t cnt = __builtin_popcountll(owned);
+        if (k >= cnt)
+        {
+            k -= cnt;
+            continue;
+        }
+        while (k--)
+            owned &= owned - 1;
+        return (long)(wi * OWNERS_PER_WORD + __builtin_ctzll(owned) / OWNER_BITS);
+    }
+    return -1;
+}
+
+#endif
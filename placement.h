@@ -0,0 +1,166 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "risk.h"
+
+#ifndef PLACEMENT_MAX_CPUS
+#define PLACEMENT_MAX_CPUS 256
+#endif
+
+/**
+ * @struct placement
+ * @brief CPUs to pin players or shard workers to
+ *
+ * Worker i runs on cpus[i % count]. With count == 0 nothing is pinned and the scheduler decides.
+ */
+typedef struct placement
+{
+    int cpus[PLACEMENT_MAX_CPUS];
+    int count;
+} placement_t;
+
+/**
+ * @brief Parses a CPU list such as "0,2,8-11"
+ *
+ * @return 1 on success, 0 if the list is malformed, too long or names a CPU this process may
+ *         not run on
+ */
+int parse_cpu_list(const char* list, placement_t* pl)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+        ERR("sched_getaffinity");
+    pl->count = 0;
+    while (*list)
+    {
+        char* end;
+        long first = strtol(list, &end, 10), last = first;
+        if (end == list || first < 0)
+            return 0;
+        if (*end == '-')
+        {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list || last < first)
+                return 0;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            if (pl->count == PLACEMENT_MAX_CPUS || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))
+                return 0;
+            pl->cpus[pl->count++] = cpu;
+        }
+        if (*end == ',')
+            end++;
+        else if (*end)
+            return 0;
+        list = end;
+    }
+    return pl->count > 0;
+}
+
+/* CPU of worker i, -1 if it is not pinned */
+static inline int placement_cpu(const placement_t* pl, int i) { return pl->count ? pl->cpus[i % pl->count] : -1; }
+
+/* Pins the calling thread (or single-threaded process) to cpu */
+void pin_to_cpu(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1)
+        ERR("sched_setaffinity");
+}
+
+/* NUMA node of a CPU as listed in sysfs, -1 if unknown */
+int cpu_node(int cpu)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR* dir = opendir(path);
+    if (!dir)
+        return -1;
+    int node = -1;
+    struct dirent* e;
+    while (node < 0 && (e = readdir(dir)))
+        if (sscanf(e->d_name, "node%d", &node) != 1)
+            node = -1;
+    closedir(dir);
+    return node;
+}
+
+/* NUMA node holding the page at addr, -1 if it is not resident or the kernel will not tell */
+int memory_node(const void* addr)
+{
+    void* page = (void*)((uintptr_t)addr & ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1));
+    int status = -1;
+    if (syscall(SYS_move_pages, 0, 1UL, &page, NULL, &status, 0) == -1 || status < 0)
+        return -1;
+    return status;
+}
+
+/* Prints where the calling thread runs, flushed since worker processes leave with _exit() */
+void report_cpu(const char* who)
+{
+    int cpu = sched_getcpu();
+    printf("%s: cpu %d, node %d\n", who, cpu, cpu >= 0 ? cpu_node(cpu) : -1);
+    fflush(stdout);
+}
+
+typedef struct touch_args
+{
+    void (*touch)(void* ctx, int part);
+    void* ctx;
+    int part;
+    int cpu;
+} touch_args_t;
+
+static void* touch_thread(void* arg)
+{
+    touch_args_t* a = arg;
+    if (a->cpu >= 0)
+        pin_to_cpu(a->cpu);
+    a->touch(a->ctx, a->part);
+    return NULL;
+}
+
+/**
+ * @brief Initializes memory part by part, each part from a thread pinned like worker part
+ *
+ * Linux places a page on the node of the CPU that first writes it, so a part touched here stays
+ * local to the worker pinned to the same CPU. The pages must not have been written before, and
+ * parts sharing a page end up on the node of whichever thread got there first: split page-aligned
+ * memory (arena_alloc_pages) at page_part_start().
+ *
+ * @param touch Writes the first time to part part of the memory
+ */
+/* Start of part part when bytes are split into parts, rounded down to a page boundary */
+size_t page_part_start(size_t bytes, int part, int parts)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    return part >= parts ? bytes : bytes * part / parts / page * page;
+}
+
+void first_touch(const placement_t* pl, int parts, void (*touch)(void* ctx, int part), void* ctx)
+{
+    pthread_t threads[parts];
+    touch_args_t args[parts];
+    for (int i = 0; i < parts; i++)
+    {
+        args[i] = (touch_args_t){.touch = touch, .ctx = ctx, .part = i, .cpu = placement_cpu(pl, i)};
+        if (pthread_create(&threads[i], NULL, touch_thread, &args[i]))
+            ERR("pthread_create");
+    }
+    for (int i = 0; i < parts; i++)
+        pthread_join(threads[i], NULL);
+}
+
+#endif
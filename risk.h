@@ -1,3 +1,6 @@
+#ifndef RISK_H
+#define RISK_H
+
 #define _GNU_SOURCE
 #include <errno.h>
 #include <pthread.h>
@@ -8,11 +11,16 @@
 #include <time.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <sys/mman.h>
 #define ERR(source) (perror(source), fprintf(stderr, "%s:%d\n", __FILE__, __LINE__), exit(EXIT_FAILURE))
 
 #define MAX_NEIGHBORS 6
+#ifndef FRUSTRATION_LIMIT
 #define FRUSTRATION_LIMIT 3
+#endif
+#ifndef MOVE_MS
 #define MOVE_MS 140
+#endif
 #define SHOW_MS 500
 /**
  * @struct region
@@ -20,48 +28,59 @@
  */
 typedef struct region
 {
-    int8_t owner;                    /* Symbol of the player that controls this region */
-    int8_t neighbors[MAX_NEIGHBORS]; /* Array of indexes of neighboring regions */
-    int8_t num_neighbors;            /* The number of neighboring regions */
+    int32_t neighbors[MAX_NEIGHBORS]; /* Array of indexes of neighboring regions */
+    int8_t num_neighbors;             /* The number of neighboring regions */
 } region_t;
 
+#define MAP_LINE_MAX 256 /* Longest line of a board file, with room to spare for MAX_NEIGHBORS */
+
 /**
- * @brief Loads a playing board from a file
- *
- * Parses the board file format and initializes all regions' owner to '-'
+ * @brief Opens a board file and counts its regions
  *
  * @param file The file to load the board from
- * @param num_regions The value under this pointer will be set to the number of regions in the returned array
- * @return An array containing all regions described in the file
+ * @param num_regions The value under this pointer will be set to the number of regions in the file
+ * @return The file, positioned at the first region, for read_regions
  */
-region_t* load_regions(char* file, int* num_regions)
+FILE* open_map(char* file, int* num_regions)
 {
     FILE* f = fopen(file, "r");
     if (!f)
         ERR("fopen");
     *num_regions = 0;
-    {
-        int c;
-        while ((c = fgetc(f)) != EOF)
-            if (c == '\n')
-                (*num_regions)++;
-        if (fseek(f, 0, SEEK_SET) == -1)
-            ERR("fseek");
-    }
-    region_t* regions = malloc(sizeof(region_t) * *num_regions);
-    if (!regions)
-        ERR("malloc");
-    memset(regions, 0, sizeof(region_t) * *num_regions);
+    int c;
+    while ((c = fgetc(f)) != EOF)
+        if (c == '\n')
+            (*num_regions)++;
+    if (fseek(f, 0, SEEK_SET) == -1)
+        ERR("fseek");
+    return f;
+}
 
-    char* line = NULL;
-    size_t capacity = 0;
-    int length = 0;
-    int i_region = 0;
-    while ((length = getline(&line, &capacity, f)) != -1)
+/**
+ * @brief Parses the regions on lines [lo, hi) of a board file
+ *
+ * Nothing is allocated, lines are read into a buffer on the stack and the ones before lo are
+ * skipped unparsed. A neighbor that is not a region of the board is an error.
+ *
+ * @param f The file, positioned at the first region
+ * @param regions Zero-filled room for hi - lo regions, regions[0] is region lo
+ * @param num_regions The number of regions on the whole board
+ */
+void read_region_lines(FILE* f, region_t* regions, int lo, int hi, int num_regions)
+{
+    char line[MAP_LINE_MAX];
+    int i_region = 0, c;
+    while (i_region < lo && (c = fgetc(f)) != EOF)
+        i_region += c == '\n';
+    while (i_region < hi && fgets(line, sizeof(line), f))
     {
-        region_t* r = &regions[i_region];
+        if (!strchr(line, '\n'))
+        {
+            fprintf(stderr, "Line %d is longer than %d characters\n", i_region, MAP_LINE_MAX - 2);
+            exit(EXIT_FAILURE);
+        }
+        region_t* r = &regions[i_region - lo];
         char* cur = strtok(line, ";");
-        r->owner = '-';
         if (*cur != '\n')
             while (cur != NULL)
             {
@@ -70,22 +89,74 @@ region_t* load_regions(char* file, int* num_regions)
                     fprintf(stderr, "Exceeded max neighbor count on line %d\n", i_region);
                     exit(EXIT_FAILURE);
                 }
-                r->neighbors[r->num_neighbors] = atoi(cur);
+                char* end;
+                long id = strtol(cur, &end, 10);
+                if (end == cur || id < 0 || id >= num_regions)
+                {
+                    fprintf(stderr, "Neighbor %.*s on line %d is not a region of the board\n",
+                            (int)strcspn(cur, "\n"), cur, i_region);
+                    exit(EXIT_FAILURE);
+                }
+                r->neighbors[r->num_neighbors] = id;
                 cur = strtok(NULL, ";");
                 r->num_neighbors++;
             }
         i_region++;
     }
-    if (!feof(f))
-        ERR("getline");
-    free(line);
+    if (ferror(f))
+        ERR("fgets");
+}
+
+/**
+ * @brief Parses all regions of a board file opened by open_map
+ *
+ * @param regions Zero-filled room for num_regions regions
+ */
+void read_regions(FILE* f, region_t* regions, int num_regions)
+{
+    read_region_lines(f, regions, 0, num_regions, num_regions);
+}
+
+/**
+ * @brief Loads a playing board from a file
+ *
+ * Parses the board file format, see read_regions
+ *
+ * @param file The file to load the board from
+ * @param num_regions The value under this pointer will be set to the number of regions in the returned array
+ * @return An array containing all regions described in the file
+ */
+region_t* load_regions(char* file, int* num_regions)
+{
+    FILE* f = open_map(file, num_regions);
+    region_t* regions = calloc(*num_regions ? *num_regions : 1, sizeof(region_t));
+    if (!regions)
+        ERR("calloc");
+    read_regions(f, regions, *num_regions);
     fclose(f);
     return regions;
 }
 
 void ms_sleep(unsigned int ms_time)
 {
-    struct timespec ts = {0, ms_time * 1000000};
+    struct timespec ts = {ms_time / 1000, (ms_time % 1000) * 1000000L};
     while (nanosleep(&ts, &ts))
         ;
 }
+
+/* Anonymous memory that stays shared with children created by fork(), zero-filled */
+void* map_shared(size_t size)
+{
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        ERR("mmap");
+    return p;
+}
+
+void unmap_shared(void* p, size_t size)
+{
+    if (munmap(p, size) == -1)
+        ERR("munmap");
+}
+
+#endif
@@ -0,0 +1,537 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "owners.h"
+#include "placement.h"
+#include "risk.h"
+
+/*
+ * Sharded simulation. The coordinator splits the board into contiguous ranges of region IDs,
+ * and a worker process owns each range. The worker reads only its own regions from the map, and
+ * keeps a halo: the owners of the out-of-range neighbors of its regions. Play advances in rounds:
+ *
+ *  1. the coordinator sends every worker the boundary changes of the previous round, which
+ *     refresh the halos;
+ *  2. each worker resolves the boundary moves deferred in the previous round, then tries
+ *     SHARD_ATTEMPTS random moves per player on its own regions;
+ *  3. each worker reports its counters and the changes of its boundary regions (those that
+ *     appear in some other shard's halo).
+ *
+ * A move backed by a neighbor in the worker's own range is applied at once. A move whose only
+ * backing neighbors are in the halo relies on last round's view of another shard, so it is
+ * deferred. At the start of the next round it is checked again against the refreshed halo. If
+ * both players still hold a legal deferred claim on the same region, the region goes to player
+ * A on even (region + round) and to player B on odd, so every run with the same moves gets the
+ * same board.
+ */
+#ifndef SHARD_ATTEMPTS
+#define SHARD_ATTEMPTS 1024 /* Random moves per player, shard and round */
+#endif
+
+#define SHARD_PLAYERS 2 /* Owner codes 1 and 2 */
+
+enum shard_cmd
+{
+    SHARD_ROUND = 0,
+    SHARD_ROBIN_HOOD = 1, /* Play a round, but first clear one owned region */
+    SHARD_STOP = 2,
+};
+
+typedef struct shard_update
+{
+    int32_t region; /* Global region ID */
+    int32_t owner;  /* New owner code */
+} shard_update_t;
+
+/* Coordinator to worker, followed by count updates */
+typedef struct shard_msg
+{
+    int32_t cmd;
+    int32_t count;
+} shard_msg_t;
+
+/* Worker to coordinator after each round, followed by count updates */
+typedef struct shard_report
+{
+    int32_t count;
+    int32_t pending;                      /* Boundary moves deferred to the next round */
+    int32_t claims[MAX_OWNER_CODE + 1];   /* Successful moves this round */
+    int32_t robbed[MAX_OWNER_CODE + 1];   /* Regions lost to Robin Hood this round */
+    int32_t held[MAX_OWNER_CODE + 1];     /* Regions held in the shard after the round */
+} shard_report_t;
+
+/**
+ * @struct shard
+ * @brief A worker's private part of the board
+ */
+typedef struct shard
+{
+    int lo, hi;        /* Global IDs [lo, hi) owned by this shard */
+    region_t* regions; /* hi - lo regions, neighbors keep their global IDs */
+    owners_t owners;   /* Owners of the shard's regions, indexed by global ID - lo */
+    int* halo;         /* Sorted global IDs of out-of-range neighbors */
+    int8_t* halo_owner;
+    int num_halo;
+    uint8_t* boundary; /* Nonzero for regions some other shard has in its halo */
+    uint8_t* dirty;    /* Boundary regions changed this round */
+    shard_update_t* changes;
+    int num_changes;
+    uint8_t* pending; /* Bit p set: player p has a deferred claim on the region */
+    int* pending_list;
+    int num_pending;
+} shard_t;
+
+/* Returns 0 if the peer closed the connection or died, SIGPIPE must be ignored */
+int write_all(int fd, const void* buf, size_t len)
+{
+    const char* p = buf;
+    while (len > 0)
+    {
+        ssize_t n = TEMP_FAILURE_RETRY(write(fd, p, len));
+        if (n == -1 && (errno == EPIPE || errno == ECONNRESET))
+            return 0;
+        if (n == -1)
+            ERR("write");
+        p += n;
+        len -= n;
+    }
+    return 1;
+}
+
+/* Returns 0 if the peer closed the connection or died before len bytes arrived */
+int read_all(int fd, void* buf, size_t len)
+{
+    char* p = buf;
+    while (len > 0)
+    {
+        ssize_t n = TEMP_FAILURE_RETRY(read(fd, p, len));
+        if (n == -1 && errno == ECONNRESET)
+            return 0;
+        if (n == -1)
+            ERR("read");
+        if (n == 0)
+            return 0;
+        p += n;
+        len -= n;
+    }
+    return 1;
+}
+
+static int cmp_int(const void* a, const void* b) { return (*(const int*)a > *(const int*)b) - (*(const int*)a < *(const int*)b); }
+
+/* Index of global ID g in the halo, -1 if absent */
+static inline int halo_index(const shard_t* s, int g)
+{
+    int lo = 0, hi = s->num_halo;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (s->halo[mid] < g)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < s->num_halo && s->halo[lo] == g ? lo : -1;
+}
+
+static inline int shard_owner(const shard_t* s, int g)
+{
+    if (g >= s->lo && g < s->hi)
+        return owner_get(&s->owners, g - s->lo);
+    int h = halo_index(s, g);
+    return h < 0 ? OWNER_NONE : s->halo_owner[h];
+}
+
+/**
+ * @brief Reads a range of the board from the map and builds its halo
+ *
+ * Only lines [lo, hi) of the map are parsed; the halo is made of the neighbor IDs on those lines
+ * that fall out of range. Adjacency is assumed symmetric: a region is on the boundary when one
+ * of its neighbors is out of range, since that neighbor's shard then has it in its halo.
+ *
+ * @param num_regions The number of regions on the whole board
+ */
+void init_shard(shard_t* s, const char* file, int lo, int hi, int num_regions)
+{
+    int n = hi - lo;
+    s->lo = lo;
+    s->hi = hi;
+    s->regions = calloc(n ? n : 1, sizeof(region_t));
+    s->boundary = calloc(n ? n : 1, 1);
+    s->dirty = calloc(n ? n : 1, 1);
+    s->pending = calloc(n ? n : 1, 1);
+    s->changes = malloc(sizeof(shard_update_t) * (n ? n : 1));
+    s->pending_list = malloc(sizeof(int) * (n ? n : 1));
+    s->halo = malloc(sizeof(int) * (n * MAX_NEIGHBORS + 1));
+    if (!s->regions || !s->boundary || !s->dirty || !s->pending || !s->changes || !s->pending_list || !s->halo)
+        ERR("malloc");
+    FILE* f = fopen(file, "r");
+    if (!f)
+        ERR("fopen");
+    read_region_lines(f, s->regions, lo, hi, num_regions);
+    fclose(f);
+    init_owners(&s->owners, n);
+    s->num_changes = s->num_pending = 0;
+
+    s->num_halo = 0;
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < s->regions[i].num_neighbors; j++)
+        {
+            int g = s->regions[i].neighbors[j];
+            if (g < lo || g >= hi)
+            {
+                s->halo[s->num_halo++] = g;
+                s->boundary[i] = 1;
+            }
+        }
+    qsort(s->halo, s->num_halo, sizeof(int), cmp_int);
+    int k = 0;
+    for (int i = 0; i < s->num_halo; i++)
+        if (k == 0 || s->halo[k - 1] != s->halo[i])
+            s->halo[k++] = s->halo[i];
+    s->num_halo = k;
+    s->halo_owner = calloc(k ? k : 1, 1);
+    if (!s->halo_owner)
+        ERR("calloc");
+}
+
+void destroy_shard(shard_t* s)
+{
+    free(s->regions);
+    destroy_owners(&s->owners);
+    free(s->halo);
+    free(s->halo_owner);
+    free(s->boundary);
+    free(s->dirty);
+    free(s->changes);
+    free(s->pending);
+    free(s->pending_list);
+}
+
+/* Sets a local region's owner, queueing the change if other shards can see it */
+void shard_set(shard_t* s, int g, int code)
+{
+    int i = g - s->lo;
+    owner_set(&s->owners, i, code);
+    if (s->boundary[i] && !s->dirty[i])
+    {
+        s->dirty[i] = 1;
+        s->changes[s->num_changes++] = (shard_update_t){.region = g};
+    }
+}
+
+/* 1: backed by an own-range neighbor, 2: backed by halo neighbors only, 0: illegal */
+int shard_legal(const shard_t* s, int g, int code)
+{
+    if (owner_get(&s->owners, g - s->lo) == code)
+        return 0;
+    const region_t* r = &s->regions[g - s->lo];
+    int halo = 0;
+    for (int j = 0; j < r->num_neighbors; j++)
+    {
+        int n = r->neighbors[j];
+        if (shard_owner(s, n) != code)
+            continue;
+        if (n >= s->lo && n < s->hi)
+            return 1;
+        halo = 1;
+    }
+    return halo ? 2 : 0;
+}
+
+void resolve_pending(shard_t* s, int round, shard_report_t* rep)
+{
+    for (int k = 0; k < s->num_pending; k++)
+    {
+        int g = s->pending_list[k], i = g - s->lo;
+        int winner = OWNER_NONE;
+        for (int p = 1; p <= SHARD_PLAYERS; p++)
+            if ((s->pending[i] & (1 << p)) && shard_legal(s, g, p))
+            {
+                if (winner == OWNER_NONE || p == 1 + (g + round) % SHARD_PLAYERS)
+                    winner = p;
+            }
+        s->pending[i] = 0;
+        if (winner != OWNER_NONE)
+        {
+            shard_set(s, g, winner);
+            rep->claims[winner]++;
+        }
+    }
+    s->num_pending = 0;
+}
+
+void shard_round(shard_t* s, int round, int robin_hood, unsigned* seed, shard_report_t* rep)
+{
+    int n = s->hi - s->lo;
+    resolve_pending(s, round, rep);
+
+    if (robin_hood)
+    {
+        size_t counts[MAX_OWNER_CODE + 1];
+        owners_count(&s->owners, counts);
+        size_t owned = n - counts[OWNER_NONE];
+        if (owned > 0)
+        {
+            long i = owners_find_owned(&s->owners, rand_r(seed) % owned);
+            rep->robbed[owner_get(&s->owners, i)]++;
+            shard_set(s, s->lo + i, OWNER_NONE);
+        }
+    }
+
+    for (int a = 0; n > 0 && a < SHARD_ATTEMPTS; a++)
+        for (int p = 1; p <= SHARD_PLAYERS; p++)
+        {
+            int g = s->lo + rand_r(seed) % n, i = g - s->lo;
+            switch (shard_legal(s, g, p))
+            {
+                case 1:
+                    shard_set(s, g, p);
+                    rep->claims[p]++;
+                    break;
+                case 2:
+                    if (!s->pending[i])
+                        s->pending_list[s->num_pending++] = g;
+                    s->pending[i] |= 1 << p;
+                    break;
+            }
+        }
+    rep->pending = s->num_pending;
+
+    size_t counts[MAX_OWNER_CODE + 1];
+    owners_count(&s->owners, counts);
+    for (int p = 0; p <= MAX_OWNER_CODE; p++)
+        rep->held[p] = counts[p];
+}
+
+/* Worker main loop: serves rounds on fd until told to stop */
+void shard_worker(int fd, const char* file, int lo, int hi, int num_regions, int a_start, int b_start)
+{
+    shard_t s;
+    init_shard(&s, file, lo, hi, num_regions);
+    printf("Shard %d-%d: owners on node %d\n", lo, hi - 1, memory_node(s.owners.words));
+    fflush(stdout);
+    unsigned seed = time(NULL) ^ getpid();
+    if (a_start >= lo && a_start < hi)
+        shard_set(&s, a_start, 1);
+    if (b_start >= lo && b_start < hi)
+        shard_set(&s, b_start, 2);
+
+    shard_update_t* in = NULL;
+    size_t in_cap = 0;
+    for (int round = 0;; round++)
+    {
+        shard_msg_t msg;
+        if (!read_all(fd, &msg, sizeof(msg)))
+            break;
+        if ((size_t)msg.count > in_cap)
+        {
+            in_cap = msg.count;
+            if (!(in = realloc(in, sizeof(shard_update_t) * in_cap)))
+                ERR("realloc");
+        }
+        if (!read_all(fd, in, sizeof(shard_update_t) * msg.count))
+            break;
+        for (int k = 0; k < msg.count; k++)
+        {
+            int h = halo_index(&s, in[k].region);
+            if (h >= 0)
+                s.halo_owner[h] = in[k].owner;
+        }
+        if (msg.cmd == SHARD_STOP)
+            break;
+
+        shard_report_t rep = {0};
+        shard_round(&s, round, msg.cmd == SHARD_ROBIN_HOOD, &seed, &rep);
+
+        for (int k = 0; k < s.num_changes; k++)
+        {
+            int g = s.changes[k].region;
+            s.changes[k].owner = owner_get(&s.owners, g - s.lo);
+            s.dirty[g - s.lo] = 0;
+        }
+        rep.count = s.num_changes;
+        if (!write_all(fd, &rep, sizeof(rep)) || !write_all(fd, s.changes, sizeof(shard_update_t) * s.num_changes))
+            break;
+        s.num_changes = 0;
+    }
+    free(in);
+    destroy_shard(&s);
+}
+
+/* A worker that closed its socket mid-game took its part of the board with it */
+void shard_died(int k)
+{
+    fprintf(stderr, "Shard %d died\n", k);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Runs a whole game split over worker processes
+ *
+ * Only the workers parse the map, each its own range of lines. The game ends once every region
+ * is owned, after FRUSTRATION_LIMIT rounds in a row without a claim or a deferred move, or on
+ * SIGTERM; SIGINT sends Robin Hood to a random shard. Both signals must be blocked by the caller.
+ * SIGPIPE is ignored, so a worker that crashed is reported instead of killing the coordinator.
+ *
+ * Worker k is pinned to placement_cpu(pl, k) before it reads its part of the board, so its regions
+ * land on that CPU's node.
+ *
+ * @param file The map, num_regions lines long
+ */
+void run_sharded(const char* file, int num_regions, int num_shards, int a_start, int b_start, const placement_t* pl)
+{
+    pid_t* pids = malloc(sizeof(pid_t) * num_shards);
+    int* fds = malloc(sizeof(int) * num_shards);
+    int* shard_held = calloc(num_shards, sizeof(int));
+    if (!pids || !fds || !shard_held)
+        ERR("malloc");
+
+    for (int k = 0; k < num_shards; k++)
+    {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1)
+            ERR("socketpair");
+        int lo = (long)num_regions * k / num_shards, hi = (long)num_regions * (k + 1) / num_shards;
+        if ((pids[k] = fork()) == -1)
+            ERR("fork");
+        if (pids[k] == 0)
+        {
+            for (int j = 0; j < k; j++)
+                close(fds[j]);
+            close(sv[0]);
+            int cpu = placement_cpu(pl, k);
+            if (cpu >= 0)
+                pin_to_cpu(cpu);
+            char who[32];
+            snprintf(who, sizeof(who), "Shard %d", k);
+            report_cpu(who);
+            shard_worker(sv[1], file, lo, hi, num_regions, a_start, b_start);
+            _exit(EXIT_SUCCESS);
+        }
+        close(sv[1]);
+        fds[k] = sv[0];
+    }
+    if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
+        ERR("signal");
+
+    /* Boundary changes collected this round, broadcast at the start of the next */
+    shard_update_t *updates = NULL, *next = NULL;
+    size_t num_updates = 0, cap = 0, num_next = 0;
+    int points[MAX_OWNER_CODE + 1] = {0}, held[MAX_OWNER_CODE + 1] = {0};
+    int idle = 0, round = 0, stop = 0;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    struct timespec last, now, zero = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &last);
+
+    for (; !stop; round++)
+    {
+        int robin_hood = -1, sig;
+        while ((sig = sigtimedwait(&set, NULL, &zero)) > 0)
+        {
+            if (sig == SIGTERM)
+            {
+                printf("Robin Hood wins\n");
+                stop = 1;
+            }
+            else if (held[1] + held[2] > 0)
+            {
+                /* Pick a shard weighted by the regions it has owned */
+                int t = rand() % (held[1] + held[2]);
+                for (robin_hood = 0; t >= shard_held[robin_hood]; robin_hood++)
+                    t -= shard_held[robin_hood];
+            }
+        }
+        if (stop)
+            break;
+
+        for (int k = 0; k < num_shards; k++)
+        {
+            shard_msg_t msg = {.cmd = k == robin_hood ? SHARD_ROBIN_HOOD : SHARD_ROUND, .count = num_updates};
+            if (!write_all(fds[k], &msg, sizeof(msg)) ||
+                !write_all(fds[k], updates, sizeof(shard_update_t) * num_updates))
+                shard_died(k);
+        }
+
+        int claims = 0, pending = 0;
+        num_next = 0;
+        for (int p = 0; p <= MAX_OWNER_CODE; p++)
+            held[p] = 0;
+        for (int k = 0; k < num_shards; k++)
+        {
+            shard_report_t rep;
+            if (!read_all(fds[k], &rep, sizeof(rep)))
+                shard_died(k);
+            if (num_next + rep.count > cap)
+            {
+                cap = 2 * (num_next + rep.count);
+                if (!(next = realloc(next, sizeof(shard_update_t) * cap)) ||
+                    !(updates = realloc(updates, sizeof(shard_update_t) * cap)))
+                    ERR("realloc");
+            }
+            if (!read_all(fds[k], next + num_next, sizeof(shard_update_t) * rep.count))
+                shard_died(k);
+            num_next += rep.count;
+            pending += rep.pending;
+            shard_held[k] = 0;
+            for (int p = 1; p <= SHARD_PLAYERS; p++)
+            {
+                claims += rep.claims[p];
+                points[p] += rep.claims[p] - rep.robbed[p];
+                held[p] += rep.held[p];
+                shard_held[k] += rep.held[p];
+            }
+        }
+        shard_update_t* t = updates;
+        updates = next;
+        next = t;
+        num_updates = num_next;
+
+        idle = claims || pending ? 0 : idle + 1;
+        if (idle >= FRUSTRATION_LIMIT || held[1] + held[2] == num_regions)
+            stop = 1;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - last.tv_sec) * 1000 + (now.tv_nsec - last.tv_nsec) / 1000000 >= SHOW_MS)
+        {
+            printf("Round %d: A holds %d, B holds %d, %zu boundary updates\n", round, held[1], held[2], num_updates);
+            last = now;
+        }
+    }
+
+    for (int k = 0; k < num_shards; k++)
+    {
+        shard_msg_t msg = {.cmd = SHARD_STOP, .count = 0};
+        if (!write_all(fds[k], &msg, sizeof(msg)))
+            shard_died(k);
+        close(fds[k]);
+    }
+    for (int k = 0; k < num_shards; k++)
+        if (waitpid(pids[k], NULL, 0) == -1)
+            ERR("waitpid");
+
+    printf("Rounds: %d over %d shards\n", round, num_shards);
+    printf("Player A points: %d\n", points[1]);
+    printf("Player B points: %d\n", points[2]);
+    printf("Player A regions: %d\n", held[1]);
+    printf("Player B regions: %d\n", held[2]);
+
+    free(updates);
+    free(next);
+    free(pids);
+    free(fds);
+    free(shard_held);
+}
+
+#endif
@@ -1,16 +1,19 @@
 #include "risk.h"
+#include "locks.h"
+#include "owners.h"
 #include "time.h"
 
 
 typedef struct {
-    char id;                  // 'A' or 'B'
+    int code;                 // Owner code, 1 for 'A' and 2 for 'B'
     int points;
     int gave_up;
 } player_t;
 
 typedef struct {
     region_t *regions;
-    pthread_mutex_t *region_mutexes;
+    owners_t *owners;
+    region_locks_t *locks;
     int num_regions;
     player_t *player;
 } shared_t;
@@ -21,17 +24,6 @@ void usage(int argc, char** argv)
     exit(EXIT_FAILURE);
 }
 
-
-void lock_regions(pthread_mutex_t *mutexes, int *ids, int count) {
-    for (int i = 0; i < count; i++)
-        pthread_mutex_lock(&mutexes[ids[i]]);
-}
-
-void unlock_regions(pthread_mutex_t *mutexes, int *ids, int count) {
-    for (int i = count - 1; i >= 0; i--)
-        pthread_mutex_unlock(&mutexes[ids[i]]);
-}
-
 void* player_thread(void* arg)
 {
     shared_t *shared = arg;
@@ -43,39 +35,32 @@ void* player_thread(void* arg)
         int r = rand() % shared->num_regions;
 
         /* Build lock set: r + neighbors */
-        int lock_ids[shared->regions[r].num_neighbors + 1];
+        int lock_ids[MAX_LOCK_SET], lock_keys[MAX_LOCK_SET];
         int count = 0;
 
         lock_ids[count++] = r;
         for (int i = 0; i < shared->regions[r].num_neighbors; i++)
             lock_ids[count++] = shared->regions[r].neighbors[i];
 
-        /* Sort to avoid deadlock */
-        for (int i = 0; i < count; i++)
-            for (int j = i + 1; j < count; j++)
-                if (lock_ids[j] < lock_ids[i]) {
-                    int tmp = lock_ids[i];
-                    lock_ids[i] = lock_ids[j];
-                    lock_ids[j] = tmp;
-                }
-
-        lock_regions(shared->region_mutexes, lock_ids, count);
+        /* Sorted and deduplicated to avoid deadlock */
+        count = lock_set(shared->locks, lock_ids, count, lock_keys);
+        lock_regions(shared->locks, lock_keys, count);
 
         int legal = 0;
 
-        if (shared->regions[r].owner == p->id) {
+        if (owner_get(shared->owners, r) == p->code) {
             illegal++;
         } else {
             for (int i = 0; i < shared->regions[r].num_neighbors; i++) {
                 int n = shared->regions[r].neighbors[i];
-                if (shared->regions[n].owner == p->id) {
+                if (owner_get(shared->owners, n) == p->code) {
                     legal = 1;
                     break;
                 }
             }
 
             if (legal) {
-                shared->regions[r].owner = p->id;
+                owner_set(shared->owners, r, p->code);
                 p->points++;
                 illegal = 0;
             } else {
@@ -83,7 +68,7 @@ void* player_thread(void* arg)
             }
         }
 
-        unlock_regions(shared->region_mutexes, lock_ids, count);
+        unlock_regions(shared->locks, lock_keys, count);
 
         if (legal)
             ms_sleep(MOVE_MS);
@@ -93,9 +78,9 @@ void* player_thread(void* arg)
     return NULL;
 }
 
-void print_board(region_t *regions, int num_regions) {
+void print_board(region_t *regions, owners_t *owners, int num_regions) {
     for (int i = 0; i < num_regions; i++) {
-        printf("%d [%c] : ", i, regions[i].owner);
+        printf("%d [%c] : ", i, owner_symbols[owner_get(owners, i)]);
         for (int j = 0; j < regions[i].num_neighbors; j++) {
             printf("%d", regions[i].neighbors[j]);
             if (j + 1 < regions[i].num_neighbors)
@@ -115,26 +100,27 @@ int main(int argc, char **argv)
     int num_regions;
     region_t *regions = load_regions(argv[1], &num_regions);
 
-    /* Per-region mutexes */
-    pthread_mutex_t *region_mutexes =
-        malloc(sizeof(pthread_mutex_t) * num_regions);
+    /* Region locks, layout picked by LOCK_MODE */
+    region_locks_t locks;
+    init_region_locks(&locks, num_regions, NULL);
 
-    for (int i = 0; i < num_regions; i++)
-        pthread_mutex_init(&region_mutexes[i], NULL);
+    /* Owners, packed outside the regions */
+    owners_t owners;
+    init_owners(&owners, num_regions);
 
     /* Players */
-    player_t A = {.id='A', .points=0, .gave_up=0};
-    player_t B = {.id='B', .points=0, .gave_up=0};
+    player_t A = {.code=1, .points=0, .gave_up=0};
+    player_t B = {.code=2, .points=0, .gave_up=0};
 
     int a_start = rand() % num_regions;
     int b_start;
     do { b_start = rand() % num_regions; } while (b_start == a_start);
 
-    regions[a_start].owner = 'A';
-    regions[b_start].owner = 'B';
+    owner_set(&owners, a_start, A.code);
+    owner_set(&owners, b_start, B.code);
 
-    shared_t sharedA = {regions, region_mutexes, num_regions, &A};
-    shared_t sharedB = {regions, region_mutexes, num_regions, &B};
+    shared_t sharedA = {regions, &owners, &locks, num_regions, &A};
+    shared_t sharedB = {regions, &owners, &locks, num_regions, &B};
 
     pthread_t ta, tb;
     pthread_create(&ta, NULL, player_thread, &sharedA);
@@ -144,13 +130,9 @@ int main(int argc, char **argv)
     while (!(A.gave_up && B.gave_up)) {
         ms_sleep(SHOW_MS);
 
-        for (int i = 0; i < num_regions; i++)
-            pthread_mutex_lock(&region_mutexes[i]);
-
-        print_board(regions, num_regions);
-
-        for (int i = num_regions - 1; i >= 0; i--)
-            pthread_mutex_unlock(&region_mutexes[i]);
+        lock_all_regions(&locks);
+        print_board(regions, &owners, num_regions);
+        unlock_all_regions(&locks);
     }
 
     pthread_join(ta, NULL);
@@ -159,9 +141,9 @@ int main(int argc, char **argv)
     printf("Player A points: %d\n", A.points);
     printf("Player B points: %d\n", B.points);
 
-    
 
-    free(region_mutexes);
+    destroy_region_locks(&locks);
+    destroy_owners(&owners);
     free(regions);
     return 0;
 }
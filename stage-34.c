@@ -1,37 +1,106 @@
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <signal.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include "risk.h"
+#include "locks.h"
+#include "moves.h"
+#include "owners.h"
+#include "board_shm.h"
+#include "shard.h"
+#include "territory.h"
+#include "frontier.h"
+#include "distance.h"
+#include "strategy.h"
+#include "metrics.h"
+#include "placement.h"
 
 typedef struct {
     char id;          /* 'A' or 'B' */
+    int code;         /* Owner code of id in the packed board */
     int points;
     int gave_up;
+    long attempts;    /* Moves tried so far, doubles as a heartbeat for the supervisor */
+    long rejected;    /* Illegal moves so far */
+    const strategy_t *strategy;
+    long decision_ns; /* Time spent in strategy->pick */
 } player_t;
 
+/* Why a game ended, kept in shared_t::over */
+typedef enum {
+    GAME_ON,
+    GAME_FULL,       /* Every region is owned */
+    GAME_STUCK,      /* Neither player has a legal move left */
+    GAME_GAVE_UP,    /* Both players gave up or died */
+    GAME_TERMINATED  /* SIGTERM */
+} game_state_t;
+
+static const char *end_reasons[] = {
+    [GAME_ON] = "still running",
+    [GAME_FULL] = "the board is full",
+    [GAME_STUCK] = "no legal move is left",
+    [GAME_GAVE_UP] = "both players gave up",
+    [GAME_TERMINATED] = "Robin Hood terminated it"
+};
+
 typedef struct {
     region_t *regions;
-    pthread_mutex_t *region_mutexes;
+    owners_t owners;    /* Who owns each region */
+    board_shm_t *board; /* Published copy of owners, scores and generation */
+    region_locks_t locks;
+    move_fn move; /* Picked once per game from the board's degree */
+    territory_t *territory;
+    frontier_t *frontier; /* Unowned and legal move counts, decide when the game is over */
+    distances_t *distances; /* NULL if no player's strategy needs them */
+    int budget;        /* Regions a strategy may visit per move */
+    claim_hook_t hook; /* Keeps the statistics above in step with every claim */
     int num_regions;
     player_t *A;
     player_t *B;
-    int terminate;
+    placement_t placement; /* -c: CPU of player A, then B */
+    int frustration; /* -f: end only when both players gave up after FRUSTRATION_LIMIT illegal moves */
+    int over;        /* game_state_t, set once */
 } shared_t;
 
+typedef struct {
+    shared_t *shared;
+    player_t *me;
+} player_args_t;
+
 
 void usage(char **argv) {
-    fprintf(stderr, "USAGE: %s map.risk\n", argv[0]);
+    fprintf(stderr, "USAGE: %s [-p | -S shards] [-s shm_name] [-A strategy] [-B strategy] [-k budget] [-f]\n"
+                    "       [-i interval_ms] [-m metrics_file] [-c cpus] [-g games] map.risk\n",
+            argv[0]);
+    fprintf(stderr, "  -p           run every player in its own process\n");
+    fprintf(stderr, "  -S shards    split the board over worker processes, played in rounds\n");
+    fprintf(stderr, "  -s shm_name  publish the board in POSIX shared memory for viewers\n");
+    fprintf(stderr, "  -A, -B       strategy of player A or B: random (default), greedy, race or defend\n");
+    fprintf(stderr, "  -k budget    regions a strategy may visit per move (default %d)\n", STRATEGY_BUDGET);
+    fprintf(stderr, "  -f           end only when both players failed %d moves in a row, as in stage-3\n",
+            FRUSTRATION_LIMIT);
+    fprintf(stderr, "  -i ms        sample the game every ms milliseconds (default %d)\n", SHOW_MS);
+    fprintf(stderr, "  -m file      write the last %d samples at exit, as CSV if file ends in .csv,\n"
+                    "               JSON lines otherwise\n", METRICS_RING);
+    fprintf(stderr, "  -c cpus      pin players (or shard workers) round-robin to a CPU list such as 0,2,8-11\n");
+    fprintf(stderr, "  -g games     play games in a row on the same memory, SIGTERM stops the series\n");
     exit(EXIT_FAILURE);
 }
 
-void print_board(region_t *regions, int n) {
+#define PRINT_CHUNK 4096
+
+void print_board(region_t *regions, owners_t *owners, int n) {
+    char symbols[PRINT_CHUNK];
     for (int i = 0; i < n; i++) {
-        printf("%d [%c] : ", i, regions[i].owner);
+        if (i % PRINT_CHUNK == 0)
+            owners_decode(owners, i, n - i < PRINT_CHUNK ? n - i : PRINT_CHUNK, symbols);
+        printf("%d [%c] : ", i, symbols[i % PRINT_CHUNK]);
         for (int j = 0; j < regions[i].num_neighbors; j++) {
             printf("%d", regions[i].neighbors[j]);
             if (j + 1 < regions[i].num_neighbors)
@@ -41,79 +110,183 @@ void print_board(region_t *regions, int n) {
     }
 }
 
-/* Lock region set in ascending order (deadlock-free) */
-void lock_regions(pthread_mutex_t *m, int *ids, int cnt) {
-    for (int i = 0; i < cnt; i++)
-        pthread_mutex_lock(&m[ids[i]]);
+static inline int game_over(shared_t *shared) { return __atomic_load_n(&shared->over, __ATOMIC_ACQUIRE); }
+
+/* Records why the game ended, the first reason wins */
+void end_game(shared_t *shared, game_state_t reason) {
+    int on = GAME_ON;
+    __atomic_compare_exchange_n(&shared->over, &on, reason, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
 }
 
-void unlock_regions(pthread_mutex_t *m, int *ids, int cnt) {
-    for (int i = cnt - 1; i >= 0; i--)
-        pthread_mutex_unlock(&m[ids[i]]);
+void track_claim(void *ctx, int r, int prev, int code) {
+    shared_t *shared = ctx;
+    territory_update(shared->territory, r, prev, code);
+    if (shared->distances)
+        distances_update(shared->distances, r, prev, code);
+    frontier_update(shared->frontier, r, prev, code);
+    if (shared->frustration)
+        return;
+    if (frontier_unowned(shared->frontier) == 0)
+        end_game(shared, GAME_FULL);
+    else if (frontier_legal(shared->frontier, shared->A->code) == 0 &&
+             frontier_legal(shared->frontier, shared->B->code) == 0)
+        end_game(shared, GAME_STUCK);
 }
 
-void *player_thread(void *arg) {
-    shared_t *shared = arg;
-    player_t *me = (pthread_equal(pthread_self(), pthread_self()) ? NULL : NULL);
-    /* player pointer is passed via shared struct below */
-    me = shared->A == NULL ? shared->B : shared->A;
+void print_territories(shared_t *shared) {
+    player_t *players[] = {shared->A, shared->B};
+    for (int i = 0; i < 2; i++) {
+        int components, largest;
+        territory_stats(shared->territory, players[i]->code, &components, &largest);
+        printf("Player %c territories: %d (largest %d)\n", players[i]->id, components, largest);
+    }
+}
 
+/*
+ * Plays until the game is over or the player has no legal move left, in a thread or in a player
+ * process. Robin Hood never hands regions back, so a player without legal moves is out for good.
+ * With -f the old rule applies instead: the player gives up after FRUSTRATION_LIMIT illegal moves
+ * in a row, and only that or SIGTERM ends the game.
+ */
+void play(shared_t *shared, player_t *me) {
     int illegal = 0;
+    player_t *opp = me == shared->A ? shared->B : shared->A;
+    int cpu = placement_cpu(&shared->placement, me->code - 1);
+    if (cpu >= 0)
+        pin_to_cpu(cpu);
+    char who[16];
+    snprintf(who, sizeof(who), "Player %c", me->id);
+    report_cpu(who);
+    strategy_ctx_t ctx = {
+        .regions = shared->regions,
+        .num_regions = shared->num_regions,
+        .dist = shared->distances,
+        .me = me->code,
+        .opp = opp->code,
+        .budget = shared->budget
+    };
 
-    while (illegal < FRUSTRATION_LIMIT) {
-
-        if (shared->terminate)
-            pthread_exit(NULL);
-
-        int r = rand() % shared->num_regions;
+    while (!shared->frustration || illegal < FRUSTRATION_LIMIT) {
 
-        /* Build lock set: r + neighbors */
-        int count = 1 + shared->regions[r].num_neighbors;
-        int ids[count];
-        ids[0] = r;
-        for (int i = 0; i < shared->regions[r].num_neighbors; i++)
-            ids[i + 1] = shared->regions[r].neighbors[i];
+        if (game_over(shared))
+            return;
+        if (!shared->frustration && frontier_legal(shared->frontier, me->code) == 0)
+            break;
 
-        /* Sort ids */
-        for (int i = 0; i < count; i++)
-            for (int j = i + 1; j < count; j++)
-                if (ids[j] < ids[i]) {
-                    int tmp = ids[i];
-                    ids[i] = ids[j];
-                    ids[j] = tmp;
-                }
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        int r = me->strategy->pick(&ctx);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        me->decision_ns += (t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec);
 
-        lock_regions(shared->region_mutexes, ids, count);
+        int prev = shared->move(shared->regions, &shared->owners, shared->board, &shared->locks, &shared->hook, r,
+                                me->code);
 
-        int legal = 0;
+        int legal = prev >= 0;
+        __atomic_store_n(&me->attempts, me->attempts + 1, __ATOMIC_RELAXED);
 
-        if (shared->regions[r].owner == me->id) {
-            illegal++;
+        if (legal) {
+            __atomic_fetch_add(&me->points, 1, __ATOMIC_RELAXED);
+            illegal = 0;
         } else {
-            for (int i = 0; i < shared->regions[r].num_neighbors; i++) {
-                int n = shared->regions[r].neighbors[i];
-                if (shared->regions[n].owner == me->id) {
-                    legal = 1;
-                    break;
-                }
-            }
-
-            if (legal) {
-                shared->regions[r].owner = me->id;
-                me->points++;
-                illegal = 0;
-            } else {
-                illegal++;
-            }
+            __atomic_store_n(&me->rejected, me->rejected + 1, __ATOMIC_RELAXED);
+            illegal++;
         }
 
-        unlock_regions(shared->region_mutexes, ids, count);
-
         if (legal)
             ms_sleep(MOVE_MS);
     }
 
-    me->gave_up = 1;
+    __atomic_store_n(&me->gave_up, 1, __ATOMIC_RELEASE);
+}
+
+void *player_thread(void *arg) {
+    player_args_t *args = arg;
+    play(args->shared, args->me);
+    return NULL;
+}
+
+pid_t player_process(shared_t *shared, player_t *me) {
+    fflush(stdout); /* Or the child prints our buffered output again */
+    pid_t pid = fork();
+    if (pid == -1)
+        ERR("fork");
+    if (pid == 0) {
+        srand(time(NULL) ^ getpid());
+        play(shared, me);
+        _exit(EXIT_SUCCESS);
+    }
+    return pid;
+}
+
+/*
+ * Reaps finished player processes and kills hung ones. A player that made no attempt for
+ * HANG_MS is considered hung; a dead or killed player just gives up, the game goes on.
+ */
+#define HANG_MS 2000
+#define SUPERVISE_MS 100 /* How often the supervisor checks on the players */
+
+typedef struct {
+    pid_t pid;   /* 0 once reaped */
+    long seen;   /* attempts at the last check */
+    int idle_ms; /* time since attempts last changed */
+} supervised_t;
+
+int supervise(shared_t *shared, player_t *players[], supervised_t children[], int n, int elapsed_ms) {
+    int alive = 0;
+    for (int i = 0; i < n; i++) {
+        supervised_t *child = &children[i];
+        player_t *p = players[i];
+        if (!child->pid)
+            continue;
+
+        int status;
+        pid_t w = waitpid(child->pid, &status, WNOHANG);
+        if (w == -1)
+            ERR("waitpid");
+        if (w == child->pid) {
+            child->pid = 0;
+            if (WIFSIGNALED(status) && WTERMSIG(status) != SIGKILL)
+                printf("Player %c crashed (signal %d)\n", p->id, WTERMSIG(status));
+            else if (WIFEXITED(status) && WEXITSTATUS(status) != EXIT_SUCCESS)
+                printf("Player %c failed (status %d)\n", p->id, WEXITSTATUS(status));
+            __atomic_store_n(&p->gave_up, 1, __ATOMIC_RELEASE);
+            board_writer_reset(shared->board, p->code);
+            continue;
+        }
+
+        alive++;
+        long attempts = __atomic_load_n(&p->attempts, __ATOMIC_RELAXED);
+        if (attempts != child->seen) {
+            child->seen = attempts;
+            child->idle_ms = 0;
+        } else if ((child->idle_ms += elapsed_ms) >= HANG_MS) {
+            printf("Player %c hung, killing it\n", p->id);
+            if (kill(child->pid, SIGKILL) == -1 && errno != ESRCH)
+                ERR("kill");
+            child->idle_ms = 0;
+        }
+    }
+    return alive;
+}
+
+typedef struct {
+    shared_t *shared;
+    player_t **players;
+    supervised_t *children;
+    int n;
+} supervisor_args_t;
+
+/*
+ * Supervises the player processes until all of them are reaped. It has a thread of its own
+ * because a hung player may hold region locks: main would block in lock_all_regions() until
+ * the player is killed, so it cannot be the one to kill it.
+ */
+void *supervisor_thread(void *arg) {
+    supervisor_args_t *a = arg;
+    do
+        ms_sleep(SUPERVISE_MS);
+    while (supervise(a->shared, a->players, a->children, a->n, SUPERVISE_MS));
     return NULL;
 }
 
@@ -126,47 +299,48 @@ void *signal_thread(void *arg) {
     sigaddset(&set, SIGINT);
     sigaddset(&set, SIGTERM);
 
+    /* main cancels us when the game ends on its own, but never while we hold region locks */
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
     while (1) {
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
         sigwait(&set, &sig);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
         if (sig == SIGINT) {
             /* Pick random owned region */
-            int owned[shared->num_regions];
-            int cnt = 0;
-
-            for (int i = 0; i < shared->num_regions; i++) {
-                if (shared->regions[i].owner == 'A' ||
-                    shared->regions[i].owner == 'B')
-                    owned[cnt++] = i;
-            }
+            size_t counts[MAX_OWNER_CODE + 1];
+            owners_count(&shared->owners, counts);
+            size_t cnt = shared->num_regions - counts[OWNER_NONE];
 
             if (cnt == 0)
                 continue;
 
-            int r = owned[rand() % cnt];
+            long r = owners_find_owned(&shared->owners, rand() % cnt);
+            if (r < 0)
+                continue;
 
-            pthread_mutex_lock(&shared->region_mutexes[r]);
-            char owner = shared->regions[r].owner;
-            shared->regions[r].owner = '-';
-            pthread_mutex_unlock(&shared->region_mutexes[r]);
+            lock_region(&shared->locks, r);
+            board_write_begin(shared->board, ROBIN_HOOD_WRITER);
+            int owner = owner_set(&shared->owners, r, OWNER_NONE);
+            board_publish(shared->board, ROBIN_HOOD_WRITER, owner, OWNER_NONE);
+            board_write_end(shared->board, ROBIN_HOOD_WRITER);
+            notify_claim(&shared->hook, r, owner, OWNER_NONE);
+            unlock_region(&shared->locks, r);
 
-            if (owner == 'A')
-                shared->A->points--;
-            else
-                shared->B->points--;
+            if (owner == shared->A->code)
+                __atomic_fetch_sub(&shared->A->points, 1, __ATOMIC_RELAXED);
+            else if (owner == shared->B->code)
+                __atomic_fetch_sub(&shared->B->points, 1, __ATOMIC_RELAXED);
 
             /* Atomic print */
-            for (int i = 0; i < shared->num_regions; i++)
-                pthread_mutex_lock(&shared->region_mutexes[i]);
-
-            print_board(shared->regions, shared->num_regions);
-
-            for (int i = shared->num_regions - 1; i >= 0; i--)
-                pthread_mutex_unlock(&shared->region_mutexes[i]);
+            lock_all_regions(&shared->locks);
+            print_board(shared->regions, &shared->owners, shared->num_regions);
+            unlock_all_regions(&shared->locks);
+            print_territories(shared);
         }
 
         else if (sig == SIGTERM) {
-            shared->terminate = 1;
+            end_game(shared, GAME_TERMINATED);
             printf("Robin Hood wins\n");
             pthread_exit(NULL);
         }
@@ -175,77 +349,397 @@ void *signal_thread(void *arg) {
 
 /* ===================== MAIN ===================== */
 
-int main(int argc, char **argv) {
-    if (argc != 2)
-        usage(argv);
+#define POLL_MS 10 /* How soon main notices that the game is over */
 
-    srand(time(NULL));
+/* Board memory split at page boundaries in one part per player, first written by a thread on that player's CPU */
+typedef struct {
+    const region_t *source;
+    region_t *regions;
+    uint64_t *words;
+    int num_regions;
+    int parts;
+} board_touch_t;
+
+void touch_board(void *ctx, int part) {
+    board_touch_t *t = ctx;
+    size_t size = sizeof(region_t) * t->num_regions;
+    size_t lo = page_part_start(size, part, t->parts), hi = page_part_start(size, part + 1, t->parts);
+    memcpy((char *)t->regions + lo, (const char *)t->source + lo, hi - lo);
+    size = sizeof(uint64_t) * owners_words(t->num_regions);
+    lo = page_part_start(size, part, t->parts);
+    hi = page_part_start(size, part + 1, t->parts);
+    memset((char *)t->words + lo, 0, hi - lo);
+}
 
-    /* Block signals in all threads */
-    sigset_t set;
-    sigemptyset(&set);
-    sigaddset(&set, SIGINT);
-    sigaddset(&set, SIGTERM);
-    pthread_sigmask(SIG_BLOCK, &set, NULL);
+/* A board smaller than a page per player leaves the first parts empty, their node is then -1 */
+void report_board(region_t *regions, owners_t *owners, int num_regions, player_t *players[], int parts) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = sizeof(region_t) * num_regions, words = sizeof(uint64_t) * owners_words(num_regions);
+    for (int i = 0; i < parts; i++) {
+        size_t lo = page_part_start(size, i, parts), hi = page_part_start(size, i + 1, parts);
+        size_t wlo = page_part_start(words, i, parts), whi = page_part_start(words, i + 1, parts);
+        printf("Board part of player %c: %zu pages of regions on node %d, %zu pages of owners on node %d\n",
+               players[i]->id, (hi - lo + page - 1) / page, hi > lo ? memory_node((char *)regions + lo) : -1,
+               (whi - wlo + page - 1) / page, whi > wlo ? memory_node((char *)owners->words + wlo) : -1);
+    }
+}
 
-    int num_regions;
-    region_t *regions = load_regions(argv[1], &num_regions);
+/* Reads the players' own counters and the frontier counters, the board stays unlocked */
+void take_sample(shared_t *shared, metrics_t *metrics, double t) {
+    player_t *players[] = {shared->A, shared->B};
+    int score[METRICS_PLAYERS];
+    long claims[METRICS_PLAYERS], rejected[METRICS_PLAYERS];
+    for (int i = 0; i < METRICS_PLAYERS; i++) {
+        score[i] = __atomic_load_n(&players[i]->points, __ATOMIC_RELAXED);
+        rejected[i] = __atomic_load_n(&players[i]->rejected, __ATOMIC_RELAXED);
+        claims[i] = __atomic_load_n(&players[i]->attempts, __ATOMIC_RELAXED) - rejected[i];
+    }
+    metrics_record(metrics, t, score, claims, rejected, frontier_contested(shared->frontier));
+}
+
+/* Everything player processes need to see, kept in the arena */
+typedef struct {
+    shared_t shared;
+    player_t A;
+    player_t B;
+} game_t;
+
+/* Command line settings, the same for every game of a run */
+typedef struct {
+    char *shm_name;
+    char *metrics_path;
+    placement_t placement;
+    int interval;
+    int processes;
+    int budget;
+    int frustration;
+    const strategy_t *strategy_a;
+    const strategy_t *strategy_b;
+} options_t;
+
+double elapsed_s(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void timespec_add_ms(struct timespec *t, int ms) {
+    t->tv_sec += ms / 1000;
+    t->tv_nsec += ms % 1000 * 1000000L;
+    if (t->tv_nsec >= 1000000000L) {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000L;
+    }
+}
 
-    pthread_mutex_t *region_mutexes =
-        malloc(sizeof(pthread_mutex_t) * num_regions);
+static int timespec_before(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
 
-    for (int i = 0; i < num_regions; i++)
-        pthread_mutex_init(&region_mutexes[i], NULL);
+typedef struct {
+    shared_t *shared;
+    metrics_t *metrics;
+    const struct timespec *start;
+    int interval;
+} sampler_args_t;
+
+/*
+ * Takes a sample at start + k * interval for k = 1, 2, ... until the game is over. It sleeps to
+ * absolute deadlines, so neither the time a sample takes nor main printing the board shifts the
+ * schedule, and wakes up at least every POLL_MS to notice the end of the game. A deadline already
+ * missed is skipped rather than caught up with.
+ */
+void *sampler_thread(void *arg) {
+    sampler_args_t *a = arg;
+    struct timespec next = *a->start, now, wake;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    while (!game_over(a->shared)) {
+        while (!timespec_before(&now, &next))
+            timespec_add_ms(&next, a->interval);
+        while (timespec_before(&now, &next) && !game_over(a->shared)) {
+            wake = now;
+            timespec_add_ms(&wake, POLL_MS);
+            if (timespec_before(&next, &wake))
+                wake = next;
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL))
+                ;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        }
+        if (!game_over(a->shared))
+            take_sample(a->shared, a->metrics, elapsed_s(a->start));
+    }
+    return NULL;
+}
 
-    player_t A = {.id = 'A', .points = 0, .gave_up = 0};
-    player_t B = {.id = 'B', .points = 0, .gave_up = 0};
+/* Arena bytes one game takes on top of the map */
+size_t game_size(const options_t *opt, int num_regions) {
+    size_t size = arena_round(sizeof(game_t)) + territory_size(num_regions, 2) + frontier_size(num_regions, 2) +
+                  board_shm_arena_size(opt->shm_name, num_regions) + region_locks_arena_size(num_regions);
+    if (opt->strategy_a->uses_distances || opt->strategy_b->uses_distances)
+        size += distances_size(num_regions, 2);
+    if (opt->metrics_path)
+        size += metrics_size(METRICS_RING);
+    return size;
+}
 
+/*
+ * Plays one game on regions with all of its state taken from arena, and returns why it ended.
+ * With pinned players, source holds the map and touch_board() copies it into regions first.
+ */
+game_state_t play_game(const options_t *opt, arena_t *arena, region_t *regions, const region_t *source,
+                       int num_regions, int number) {
     int a_start = rand() % num_regions;
     int b_start;
     do { b_start = rand() % num_regions; } while (b_start == a_start);
 
-    regions[a_start].owner = 'A';
-    regions[b_start].owner = 'B';
+    game_t *game = arena_alloc(arena, sizeof(game_t));
+    player_t *A = &game->A, *B = &game->B;
+    *A = (player_t){.id = 'A', .code = 1, .points = 0, .gave_up = 0, .strategy = opt->strategy_a};
+    *B = (player_t){.id = 'B', .code = 2, .points = 0, .gave_up = 0, .strategy = opt->strategy_b};
 
-    shared_t shared = {
+    shared_t *shared = &game->shared;
+    *shared = (shared_t){
         .regions = regions,
-        .region_mutexes = region_mutexes,
         .num_regions = num_regions,
-        .A = &A,
-        .B = &B,
-        .terminate = 0
+        .A = A,
+        .B = B,
+        .budget = opt->budget,
+        .placement = opt->placement,
+        .frustration = opt->frustration,
+        .over = GAME_ON
     };
 
-    pthread_t ta, tb, ts;
-    pthread_create(&ta, NULL, player_thread, &shared);
-    pthread_create(&tb, NULL, player_thread, &shared);
-    pthread_create(&ts, NULL, signal_thread, &shared);
+    shared->territory = create_territory(regions, num_regions, 2, arena);
+    shared->frontier = create_frontier(regions, num_regions, 2, arena);
+    if (opt->strategy_a->uses_distances || opt->strategy_b->uses_distances)
+        shared->distances = create_distances(regions, num_regions, 2, arena);
+    shared->hook = (claim_hook_t){.fn = track_claim, .ctx = shared};
+
+    shared->board = create_board_shm(opt->shm_name, num_regions, &shared->owners, arena);
+    player_t *players[] = {A, B};
+    if (source) {
+        board_touch_t touch = {
+            .source = source,
+            .regions = regions,
+            .words = shared->owners.words,
+            .num_regions = num_regions,
+            .parts = 2
+        };
+        first_touch(&opt->placement, 2, touch_board, &touch);
+    }
+    report_board(regions, &shared->owners, num_regions, players, 2);
+    board_write_begin(shared->board, ROBIN_HOOD_WRITER);
+    owner_set(&shared->owners, a_start, A->code);
+    owner_set(&shared->owners, b_start, B->code);
+    notify_claim(&shared->hook, a_start, OWNER_NONE, A->code);
+    notify_claim(&shared->hook, b_start, OWNER_NONE, B->code);
+    board_publish(shared->board, ROBIN_HOOD_WRITER, OWNER_NONE, A->code);
+    board_publish(shared->board, ROBIN_HOOD_WRITER, OWNER_NONE, B->code);
+    board_write_end(shared->board, ROBIN_HOOD_WRITER);
+    init_region_locks(&shared->locks, num_regions, arena);
+    shared->move = select_move_kernel(regions, num_regions);
+
+    metrics_t metrics;
+    if (opt->metrics_path)
+        init_metrics(&metrics, METRICS_RING, arena);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    player_args_t args[] = {{.shared = shared, .me = A}, {.shared = shared, .me = B}};
+    supervised_t children[2] = {{0}};
+    supervisor_args_t supervisor = {.shared = shared, .players = players, .children = children, .n = 2};
+    sampler_args_t sampler = {.shared = shared, .metrics = &metrics, .start = &start, .interval = opt->interval};
+    pthread_t tp[2], ts, tv, tm;
+    /* Fork before any thread exists, children get a single-threaded copy */
+    for (int i = 0; i < 2; i++) {
+        if (opt->processes)
+            children[i].pid = player_process(shared, players[i]);
+        else
+            pthread_create(&tp[i], NULL, player_thread, &args[i]);
+    }
+    if (opt->processes)
+        pthread_create(&tv, NULL, supervisor_thread, &supervisor);
+    pthread_create(&ts, NULL, signal_thread, shared);
+
+    if (opt->metrics_path) {
+        take_sample(shared, &metrics, 0);
+        pthread_create(&tm, NULL, sampler_thread, &sampler);
+    }
+    while (!game_over(shared)) {
+        for (int slept = 0; slept < SHOW_MS && !game_over(shared); slept += POLL_MS)
+            ms_sleep(POLL_MS);
+        if (__atomic_load_n(&A->gave_up, __ATOMIC_ACQUIRE) && __atomic_load_n(&B->gave_up, __ATOMIC_ACQUIRE))
+            end_game(shared, GAME_GAVE_UP);
+        lock_all_regions(&shared->locks);
+        print_board(regions, &shared->owners, num_regions);
+        unlock_all_regions(&shared->locks);
+        print_territories(shared);
+    }
+    double seconds = elapsed_s(&start);
+    if (opt->metrics_path) {
+        pthread_join(tm, NULL);
+        take_sample(shared, &metrics, seconds);
+    }
+
+    if (opt->processes)
+        pthread_join(tv, NULL);
+    else
+        for (int i = 0; i < 2; i++)
+            pthread_join(tp[i], NULL);
+    pthread_cancel(ts);
+    pthread_join(ts, NULL);
 
-    while (!(A.gave_up && B.gave_up) && !shared.terminate) {
-        ms_sleep(SHOW_MS);
-        for (int i = 0; i < num_regions; i++)
-            pthread_mutex_lock(&region_mutexes[i]);
+    printf("Game over after %.2f s: %s\n", seconds, end_reasons[shared->over]);
+    printf("Player A points: %d\n", A->points);
+    printf("Player B points: %d\n", B->points);
+    print_territories(shared);
+    for (int i = 0; i < 2; i++)
+        printf("Player %c attempts: %ld (%.0f/s), strategy %s: %.0f ns/decision\n", players[i]->id,
+               players[i]->attempts, players[i]->attempts / seconds, players[i]->strategy->name,
+               players[i]->attempts ? (double)players[i]->decision_ns / players[i]->attempts : 0.0);
+
+    if (opt->metrics_path) {
+        write_metrics(&metrics, opt->metrics_path, "AB", number);
+        printf("Metrics: %zu samples written to %s (%zu dropped)\n", metrics.taken - metrics_dropped(&metrics),
+               opt->metrics_path, metrics_dropped(&metrics));
+    }
 
-        print_board(regions, num_regions);
+    /* The memory itself goes back when the caller resets the arena */
+    destroy_region_locks(&shared->locks);
+    destroy_territory(shared->territory);
+    destroy_frontier(shared->frontier);
+    if (shared->distances)
+        destroy_distances(shared->distances);
+    destroy_board_shm(shared->board, opt->shm_name);
+    return shared->over;
+}
 
-        for (int i = num_regions - 1; i >= 0; i--)
-            pthread_mutex_unlock(&region_mutexes[i]);
+int main(int argc, char **argv) {
+    options_t opt = {
+        .shm_name = NULL,
+        .metrics_path = NULL,
+        .placement = {.count = 0},
+        .interval = SHOW_MS,
+        .processes = 0,
+        .budget = STRATEGY_BUDGET,
+        .frustration = 0,
+        .strategy_a = find_strategy("random"),
+        .strategy_b = find_strategy("random")
+    };
+    int shards = 0, games = 1;
+    int engine_opts = 0; /* -A, -B, -k, -f or -i, which the shard workers have no use for */
+    int c;
+    while ((c = getopt(argc, argv, "pS:s:A:B:k:fi:m:c:g:")) != -1) {
+        switch (c) {
+        case 'p':
+            opt.processes = 1;
+            break;
+        case 'S':
+            shards = atoi(optarg);
+            if (shards <= 0)
+                usage(argv);
+            break;
+        case 's':
+            opt.shm_name = optarg;
+            break;
+        case 'A':
+            if (!(opt.strategy_a = find_strategy(optarg)))
+                usage(argv);
+            engine_opts = 1;
+            break;
+        case 'B':
+            if (!(opt.strategy_b = find_strategy(optarg)))
+                usage(argv);
+            engine_opts = 1;
+            break;
+        case 'f':
+            opt.frustration = 1;
+            engine_opts = 1;
+            break;
+        case 'i':
+            opt.interval = atoi(optarg);
+            if (opt.interval <= 0)
+                usage(argv);
+            engine_opts = 1;
+            break;
+        case 'm':
+            opt.metrics_path = optarg;
+            break;
+        case 'c':
+            if (!parse_cpu_list(optarg, &opt.placement))
+                usage(argv);
+            break;
+        case 'k':
+            opt.budget = atoi(optarg);
+            if (opt.budget <= 0)
+                usage(argv);
+            engine_opts = 1;
+            break;
+        case 'g':
+            games = atoi(optarg);
+            if (games <= 0)
+                usage(argv);
+            break;
+        default:
+            usage(argv);
+        }
     }
+    if (argc - optind != 1 || (opt.processes && shards) ||
+        ((opt.shm_name || opt.metrics_path || games > 1 || engine_opts) && shards))
+        usage(argv);
 
-    pthread_join(ta, NULL);
-    pthread_join(tb, NULL);
-    pthread_join(ts, NULL);
+    srand(time(NULL));
+
+    /* Block signals in all threads (and player processes, which inherit the mask) */
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
 
-    printf("Player A points: %d\n", A.points);
-    printf("Player B points: %d\n", B.points);
+    int num_regions;
+    if (shards) {
+        /* The workers read their own lines, here the map is only counted */
+        fclose(open_map(argv[optind], &num_regions));
+        int a_start = rand() % num_regions;
+        int b_start;
+        do { b_start = rand() % num_regions; } while (b_start == a_start);
+        run_sharded(argv[optind], num_regions, shards, a_start, b_start, &opt.placement);
+        return 0;
+    }
 
-    for (int i = 0; i < num_regions; i++) {
-        pthread_mutex_destroy(&region_mutexes[i]);
-        free(regions[i].neighbors);
+    /*
+     * One arena holds the map and every game's state, sized from the map's line count. It is
+     * shared with -p, so the player processes see the map and the lock table. When the players
+     * are pinned, the map is read into source and regions, on pages of its own, stays untouched
+     * until touch_board() fills it in from each player's CPU.
+     */
+    FILE *map = open_map(argv[optind], &num_regions);
+    size_t map_size = arena_round(sizeof(region_t) * num_regions);
+    if (opt.placement.count)
+        map_size += arena_page_round(sizeof(region_t) * num_regions);
+    arena_t arena;
+    init_arena(&arena, map_size + game_size(&opt, num_regions), opt.processes);
+    printf("Arena: %zu bytes, %zu for the map and %zu per game\n", arena.size, map_size, game_size(&opt, num_regions));
+    region_t *regions = arena_alloc(&arena, sizeof(region_t) * num_regions), *source = NULL;
+    read_regions(map, regions, num_regions);
+    fclose(map);
+    if (opt.placement.count) {
+        source = regions;
+        regions = arena_alloc_pages(&arena, sizeof(region_t) * num_regions);
     }
 
-    free(region_mutexes);
-    free(regions);
+    size_t mark = arena_mark(&arena);
+    for (int i = 0; i < games; i++) {
+        if (games > 1)
+            printf("Game %d of %d\n", i + 1, games);
+        game_state_t end = play_game(&opt, &arena, regions, source, num_regions, i);
+        arena_reset(&arena, mark);
+        if (end == GAME_TERMINATED)
+            break;
+    }
+    destroy_arena(&arena);
 
     return 0;
 }
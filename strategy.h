@@ -0,0 +1,146 @@
+#ifndef STRATEGY_H
+#define STRATEGY_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "distance.h"
+#include "owners.h"
+#include "risk.h"
+
+#ifndef STRATEGY_BUDGET
+#define STRATEGY_BUDGET 32 /* Default number of regions one decision may visit */
+#endif
+
+/**
+ * @struct strategy_ctx
+ * @brief What a strategy sees when it picks the next region to claim
+ */
+typedef struct strategy_ctx
+{
+    const region_t* regions;
+    int num_regions;
+    distances_t* dist; /* NULL unless a strategy of the game uses distance fields */
+    int me;            /* Owner code of the player */
+    int opp;           /* Owner code of the opponent */
+    int budget;        /* Regions one decision may visit */
+} strategy_ctx_t;
+
+/**
+ * @struct strategy
+ * @brief A way of picking moves
+ *
+ * pick() returns the region to try next. It never touches the region locks, so the move can
+ * still turn out illegal by the time it is tried.
+ */
+typedef struct strategy
+{
+    const char* name;
+    int (*pick)(const strategy_ctx_t* ctx);
+    int uses_distances; /* Needs ctx->dist */
+} strategy_t;
+
+/* Scores a legal candidate, higher is better */
+typedef int (*candidate_score_fn)(const strategy_ctx_t* ctx, int x);
+
+/*
+ * Samples the player's frontier: from a random region, walk down the player's distance field
+ * until reaching a region at distance 1, i.e. a legal move. Inside the player's territory the walk
+ * moves to a random neighbor instead. Every region visited costs one unit of the budget, and the
+ * best scoring frontier region found when the budget runs out is returned.
+ *
+ * The fields are read without the distances mutex, so the claim hooks of both players never
+ * wait for a decision. A field that an update is repairing can send the walk a wrong way or
+ * score a region on a stale distance. That only makes the pick worse, and the budget still
+ * bounds the walk; the move kernel checks legality under the region locks anyway.
+ */
+static int pick_frontier(const strategy_ctx_t* ctx, candidate_score_fn score)
+{
+    const distances_t* d = ctx->dist;
+    int best = -1, best_score = 0;
+
+    for (int spent = 0; spent < ctx->budget;)
+    {
+        int x = rand() % ctx->num_regions;
+        spent++;
+        int dx = dist_get(d, ctx->me, x);
+        if (dx >= DIST_INF)
+            continue;
+        while (dx != 1 && spent < ctx->budget)
+        {
+            const region_t* rx = &ctx->regions[x];
+            if (rx->num_neighbors == 0)
+                break;
+            int next = rx->neighbors[rand() % rx->num_neighbors];
+            for (int k = 0; k < rx->num_neighbors && dx > 0; k++)
+                if (dist_get(d, ctx->me, rx->neighbors[k]) == dx - 1)
+                {
+                    next = rx->neighbors[k];
+                    break;
+                }
+            x = next;
+            dx = dist_get(d, ctx->me, x);
+            spent++;
+        }
+        if (dx != 1)
+            continue;
+        int s = score(ctx, x);
+        if (best < 0 || s > best_score)
+        {
+            best = x;
+            best_score = s;
+        }
+    }
+
+    return best >= 0 ? best : rand() % ctx->num_regions;
+}
+
+static int count_neighbors_owned(const strategy_ctx_t* ctx, int x, int code)
+{
+    const region_t* rx = &ctx->regions[x];
+    int n = 0;
+    for (int k = 0; k < rx->num_neighbors; k++)
+        n += owner_get(&ctx->dist->owners, rx->neighbors[k]) == code;
+    return n;
+}
+
+/* Unowned regions first, then the ones opening up the most unowned neighbors */
+static int score_greedy(const strategy_ctx_t* ctx, int x)
+{
+    return (owner_get(&ctx->dist->owners, x) == OWNER_NONE) * (MAX_NEIGHBORS + 1) +
+           count_neighbors_owned(ctx, x, OWNER_NONE);
+}
+
+/* Closest to the opponent's territory */
+static int score_race(const strategy_ctx_t* ctx, int x) { return -dist_get(ctx->dist, ctx->opp, x); }
+
+/* Take back the opponent's regions along the border, then fill the gaps next to our own */
+static int score_defend(const strategy_ctx_t* ctx, int x)
+{
+    int opponent = owner_get(&ctx->dist->owners, x) == ctx->opp;
+    int exposed = dist_get(ctx->dist, ctx->opp, x) <= 1;
+    return opponent * 2 * (MAX_NEIGHBORS + 1) + exposed * (MAX_NEIGHBORS + 1) + count_neighbors_owned(ctx, x, ctx->me);
+}
+
+int pick_random(const strategy_ctx_t* ctx) { return rand() % ctx->num_regions; }
+int pick_greedy(const strategy_ctx_t* ctx) { return pick_frontier(ctx, score_greedy); }
+int pick_race(const strategy_ctx_t* ctx) { return pick_frontier(ctx, score_race); }
+int pick_defend(const strategy_ctx_t* ctx) { return pick_frontier(ctx, score_defend); }
+
+static const strategy_t strategies[] = {
+    {"random", pick_random, 0},
+    {"greedy", pick_greedy, 1},
+    {"race", pick_race, 1},
+    {"defend", pick_defend, 1},
+};
+
+/* NULL if there is no strategy called name */
+const strategy_t* find_strategy(const char* name)
+{
+    for (size_t i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++)
+        if (!strcmp(strategies[i].name, name))
+            return &strategies[i];
+    return NULL;
+}
+
+#endif
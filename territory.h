@@ -0,0 +1,361 @@
+#ifndef TERRITORY_H
+#define TERRITORY_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "locks.h"
+#include "owners.h"
+#include "risk.h"
+
+/**
+ * @struct territory
+ * @brief Connected territories of every player, maintained incrementally
+ *
+ * Every owned region carries the label of its territory. A claim that joins territories
+ * relabels the smaller ones into the largest, so it costs no more than their size. Losing a
+ * region can split a territory: searches start from each of the lost region's neighbors in that
+ * territory and advance one region at a time in turn. Searches that meet are joined. Once every
+ * search but one has run out of regions, the pieces they found are complete and are the only
+ * ones relabelled. A region with at most one neighbor in the territory cannot split it, so no
+ * search runs. Per player, a histogram of territory sizes keeps the largest territory up to
+ * date. Both counters can be read in O(1).
+ *
+ * The structure keeps its own copy of the owners. It changes only through territory_update(),
+ * so it always agrees with the order of updates, even while moves are in flight. If a player
+ * process dies halfway through an update, the next holder of the mutex rebuilds everything
+ * from the copy.
+ */
+typedef struct territory
+{
+    pthread_mutex_t mutex;
+    int num_regions;
+    int players; /* Owner codes 1..players are tracked */
+    const region_t* regions;
+    owners_t owners;
+    int* label;       /* Territory of every region a tracked player owns */
+    int* size;        /* Territory sizes, indexed by label */
+    int* free_labels; /* Stack of unused labels */
+    int num_free;
+    int* mark;  /* Search stamps */
+    int* queue; /* Flood fill queue, or the links of the searches in territory_remove() */
+    int stamp;
+    int* hist;  /* hist[p * (num_regions + 1) + s]: territories of player p of size s */
+    int components[MAX_OWNER_CODE + 1];
+    int largest[MAX_OWNER_CODE + 1];
+} territory_t;
+
+static inline int* territory_hist(territory_t* t, int p, int size) { return &t->hist[p * (t->num_regions + 1) + size]; }
+
+static void hist_add(territory_t* t, int p, int size)
+{
+    (*territory_hist(t, p, size))++;
+    t->components[p]++;
+    if (size > t->largest[p])
+        t->largest[p] = size;
+}
+
+static void hist_remove(territory_t* t, int p, int size)
+{
+    (*territory_hist(t, p, size))--;
+    t->components[p]--;
+    while (t->largest[p] > 0 && *territory_hist(t, p, t->largest[p]) == 0)
+        t->largest[p]--;
+}
+
+static inline int label_new(territory_t* t) { return t->free_labels[--t->num_free]; }
+
+static inline void label_free(territory_t* t, int l) { t->free_labels[t->num_free++] = l; }
+
+/* Reserves count consecutive search stamps, returns the first */
+static int territory_stamps(territory_t* t, int count)
+{
+    if (t->stamp > INT_MAX - count)
+    {
+        memset(t->mark, 0, sizeof(int) * t->num_regions);
+        t->stamp = 0;
+    }
+    t->stamp += count;
+    return t->stamp - count + 1;
+}
+
+/* Moves the territory of p around start to label to, returns its size */
+static int territory_relabel(territory_t* t, int start, int p, int to)
+{
+    int from = t->label[start], head = 0, tail = 0;
+    t->queue[tail++] = start;
+    t->label[start] = to;
+    while (head < tail)
+    {
+        const region_t* rx = &t->regions[t->queue[head++]];
+        for (int k = 0; k < rx->num_neighbors; k++)
+        {
+            int y = rx->neighbors[k];
+            if (t->label[y] == from && owner_get(&t->owners, y) == p)
+            {
+                t->label[y] = to;
+                t->queue[tail++] = y;
+            }
+        }
+    }
+    return tail;
+}
+
+/* r has just joined p's territory: it merges the territories around it into the largest one */
+static void territory_add(territory_t* t, int r, int p)
+{
+    const region_t* reg = &t->regions[r];
+    int target = -1;
+    for (int j = 0; j < reg->num_neighbors; j++)
+    {
+        int y = reg->neighbors[j];
+        if (owner_get(&t->owners, y) == p && (target < 0 || t->size[t->label[y]] > t->size[target]))
+            target = t->label[y];
+    }
+    if (target < 0)
+    {
+        target = label_new(t);
+        t->size[target] = 0;
+    }
+    int before = t->size[target];
+    t->label[r] = target;
+    t->size[target]++;
+    for (int j = 0; j < reg->num_neighbors; j++)
+    {
+        int y = reg->neighbors[j], l = t->label[y];
+        if (owner_get(&t->owners, y) == p && l != target)
+        {
+            hist_remove(t, p, t->size[l]);
+            t->size[target] += territory_relabel(t, y, p, target);
+            label_free(t, l);
+        }
+    }
+    /* Adding the new size first keeps hist_remove() from scanning down for the largest */
+    hist_add(t, p, t->size[target]);
+    if (before > 0)
+        hist_remove(t, p, before);
+}
+
+/* Makes the unmarked piece of p's territory around start a new territory */
+static void territory_fill(territory_t* t, int start, int p, int stamp)
+{
+    int l = label_new(t), head = 0, tail = 0;
+    t->queue[tail++] = start;
+    t->mark[start] = stamp;
+    while (head < tail)
+    {
+        int x = t->queue[head++];
+        t->label[x] = l;
+        const region_t* rx = &t->regions[x];
+        for (int k = 0; k < rx->num_neighbors; k++)
+        {
+            int y = rx->neighbors[k];
+            if (t->mark[y] != stamp && owner_get(&t->owners, y) == p)
+            {
+                t->mark[y] = stamp;
+                t->queue[tail++] = y;
+            }
+        }
+    }
+    t->size[l] = tail;
+    hist_add(t, p, tail);
+}
+
+static inline int search_group(const int* group, int s)
+{
+    while (group[s] != s)
+        s = group[s];
+    return s;
+}
+
+/*
+ * r has just left p's territory. Search s marks its regions with stamp base + s and keeps them
+ * in a list linked through queue, from first[s]; head[s] is the next one to expand, -1 once
+ * the search has run out of regions.
+ */
+static void territory_remove(territory_t* t, int r, int p)
+{
+    int old = t->label[r], total = t->size[old];
+    const region_t* reg = &t->regions[r];
+    int base = territory_stamps(t, MAX_NEIGHBORS);
+    int first[MAX_NEIGHBORS], head[MAX_NEIGHBORS], last[MAX_NEIGHBORS], count[MAX_NEIGHBORS], group[MAX_NEIGHBORS];
+    int n = 0;
+    for (int j = 0; j < reg->num_neighbors; j++)
+    {
+        int y = reg->neighbors[j];
+        if (owner_get(&t->owners, y) == p && t->mark[y] < base)
+        {
+            t->mark[y] = base + n;
+            t->queue[y] = -1;
+            first[n] = head[n] = last[n] = y;
+            count[n] = 1;
+            group[n] = n;
+            n++;
+        }
+    }
+
+    /* Expand every search by one region per turn until at most one group is still running */
+    int running = n;
+    while (running > 1)
+    {
+        for (int s = 0; s < n; s++)
+        {
+            int x = head[s];
+            if (x < 0)
+                continue;
+            const region_t* rx = &t->regions[x];
+            for (int k = 0; k < rx->num_neighbors; k++)
+            {
+                int y = rx->neighbors[k];
+                if (owner_get(&t->owners, y) != p)
+                    continue;
+                if (t->mark[y] < base)
+                {
+                    t->mark[y] = base + s;
+                    t->queue[y] = -1;
+                    t->queue[last[s]] = y;
+                    last[s] = y;
+                    count[s]++;
+                }
+                else
+                {
+                    int a = search_group(group, s), b = search_group(group, t->mark[y] - base);
+                    if (a != b)
+                        group[b] = a;
+                }
+            }
+            head[s] = t->queue[x];
+        }
+        running = 0;
+        for (int g = 0; g < n; g++)
+        {
+            int live = 0;
+            for (int s = 0; s < n; s++)
+                live |= search_group(group, s) == g && head[s] >= 0;
+            running += live;
+        }
+    }
+
+    /* The running group, or else the largest piece, keeps the old label */
+    int size[MAX_NEIGHBORS] = {0}, keep = -1;
+    for (int s = 0; s < n; s++)
+        size[search_group(group, s)] += count[s];
+    for (int s = 0; s < n; s++)
+        if (head[s] >= 0)
+            keep = search_group(group, s);
+    for (int g = 0; keep < 0 && g < n; g++)
+        if (group[g] == g && (keep < 0 || size[g] > size[keep]))
+            keep = g;
+
+    int rest = total - 1;
+    for (int g = 0; g < n; g++)
+    {
+        if (group[g] != g || g == keep)
+            continue;
+        int l = label_new(t);
+        for (int s = 0; s < n; s++)
+            if (search_group(group, s) == g)
+                for (int x = first[s]; x >= 0; x = t->queue[x])
+                    t->label[x] = l;
+        t->size[l] = size[g];
+        hist_add(t, p, size[g]);
+        rest -= size[g];
+    }
+    if (rest > 0)
+    {
+        t->size[old] = rest;
+        hist_add(t, p, rest);
+    }
+    else
+        label_free(t, old);
+    hist_remove(t, p, total);
+}
+
+/* Recomputes all territories from the owners copy, one flood fill each */
+static void territory_rebuild(territory_t* t)
+{
+    memset(t->hist, 0, sizeof(int) * (t->players + 1) * (t->num_regions + 1));
+    memset(t->components, 0, sizeof(t->components));
+    memset(t->largest, 0, sizeof(t->largest));
+    t->num_free = t->num_regions;
+    for (int l = 0; l < t->num_regions; l++)
+        t->free_labels[l] = t->num_regions - 1 - l;
+    int stamp = territory_stamps(t, 1);
+    for (int r = 0; r < t->num_regions; r++)
+    {
+        int p = owner_get(&t->owners, r);
+        if (p >= 1 && p <= t->players && t->mark[r] != stamp)
+            territory_fill(t, r, p, stamp);
+    }
+}
+
+static void territory_lock(territory_t* t)
+{
+    if (lock_robust_mutex(&t->mutex))
+        territory_rebuild(t);
+}
+
+/* Arena bytes taken by create_territory() */
+size_t territory_size(int num_regions, int players)
+{
+    return arena_round(sizeof(territory_t)) + arena_round(owners_words(num_regions) * sizeof(uint64_t)) +
+           5 * arena_round(sizeof(int) * num_regions) + arena_round(sizeof(int) * (players + 1) * (num_regions + 1));
+}
+
+/**
+ * @brief Allocates territory tracking for a board with no owned regions
+ *
+ * @param players Owner codes 1..players are tracked
+ * @param arena Where the tracking lives
+ */
+territory_t* create_territory(const region_t* regions, int num_regions, int players, arena_t* arena)
+{
+    territory_t* t = arena_alloc(arena, sizeof(territory_t));
+    t->num_regions = num_regions;
+    t->players = players;
+    t->regions = regions;
+    t->owners.count = num_regions;
+    t->owners.words = arena_alloc(arena, owners_words(num_regions) * sizeof(uint64_t));
+    t->label = arena_alloc(arena, sizeof(int) * num_regions);
+    t->size = arena_alloc(arena, sizeof(int) * num_regions);
+    t->free_labels = arena_alloc(arena, sizeof(int) * num_regions);
+    t->mark = arena_alloc(arena, sizeof(int) * num_regions);
+    t->queue = arena_alloc(arena, sizeof(int) * num_regions);
+    t->hist = arena_alloc(arena, sizeof(int) * (players + 1) * (num_regions + 1));
+    territory_rebuild(t); /* Hands out the labels */
+    init_robust_mutex(&t->mutex, arena->shared);
+    return t;
+}
+
+void destroy_territory(territory_t* t) { pthread_mutex_destroy(&t->mutex); }
+
+/*
+ * Records that region r went to owner code code. The previous owner comes from the copy, not
+ * from the caller's prev: they only differ when the claim before this one died before its
+ * update, and then the copy is what the tracking agrees with.
+ */
+void territory_update(territory_t* t, int r, int prev, int code)
+{
+    territory_lock(t);
+    prev = owner_set(&t->owners, r, code);
+    if (prev != code)
+    {
+        if (prev >= 1 && prev <= t->players)
+            territory_remove(t, r, prev);
+        if (code >= 1 && code <= t->players)
+            territory_add(t, r, code);
+    }
+    pthread_mutex_unlock(&t->mutex);
+}
+
+/* Number of separate territories of player p and the size of the largest one */
+void territory_stats(territory_t* t, int p, int* components, int* largest)
+{
+    territory_lock(t);
+    *components = t->components[p];
+    *largest = t->largest[p];
+    pthread_mutex_unlock(&t->mutex);
+}
+
+#endif
@@ -0,0 +1,106 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "risk.h"
+#include "owners.h"
+#include "board_shm.h"
+
+#define DEFAULT_FPS 10
+#define DEFAULT_WIDTH 64
+#define SNAPSHOT_ATTEMPTS 100
+
+void usage(char **argv) {
+    fprintf(stderr, "USAGE: %s [-f fps] [-w width] shm_name\n", argv[0]);
+    fprintf(stderr, "  Renders a board published by stage-34 -s shm_name\n");
+    exit(EXIT_FAILURE);
+}
+
+/* Maps the segment read-only, waiting for the engine to create and fill in the header */
+const board_shm_t *attach_board(const char *name) {
+    int fd;
+    while ((fd = shm_open(name, O_RDONLY, 0)) == -1) {
+        if (errno != ENOENT)
+            ERR("shm_open");
+        ms_sleep(100);
+    }
+
+    struct stat st;
+    while (1) {
+        if (fstat(fd, &st) == -1)
+            ERR("fstat");
+        if ((size_t)st.st_size >= sizeof(board_shm_t))
+            break;
+        ms_sleep(100);
+    }
+
+    const board_shm_t *b = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (b == MAP_FAILED)
+        ERR("mmap");
+    close(fd);
+
+    while (__atomic_load_n(&b->magic, __ATOMIC_ACQUIRE) != BOARD_SHM_MAGIC)
+        ms_sleep(100);
+    if (b->owner_bits != OWNER_BITS || (size_t)st.st_size < board_shm_size(b->num_regions)) {
+        fprintf(stderr, "%s: board layout does not match this viewer\n", name);
+        exit(EXIT_FAILURE);
+    }
+    return b;
+}
+
+void render(const owners_t *owners, const int32_t *scores, uint64_t generation, int width) {
+    char row[width];
+    printf("\033[H\033[2J");
+    printf("generation %lu  A: %d  B: %d\n", (unsigned long)generation, scores[1], scores[2]);
+    for (size_t i = 0; i < owners->count; i += width) {
+        size_t n = owners->count - i < (size_t)width ? owners->count - i : (size_t)width;
+        owners_decode(owners, i, n, row);
+        printf("%.*s\n", (int)n, row);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    int fps = DEFAULT_FPS, width = DEFAULT_WIDTH;
+    int c;
+    while ((c = getopt(argc, argv, "f:w:")) != -1) {
+        switch (c) {
+        case 'f':
+            fps = atoi(optarg);
+            break;
+        case 'w':
+            width = atoi(optarg);
+            break;
+        default:
+            usage(argv);
+        }
+    }
+    if (argc - optind != 1 || fps <= 0 || width <= 0)
+        usage(argv);
+
+    const board_shm_t *board = attach_board(argv[optind]);
+
+    /* Render from a private copy so the engine never waits for us */
+    owners_t copy;
+    init_owners(&copy, board->num_regions);
+    int32_t scores[MAX_OWNER_CODE + 1];
+    uint64_t generation, shown = UINT64_MAX;
+
+    while (!__atomic_load_n(&board->finished, __ATOMIC_ACQUIRE)) {
+        if (board_shm_snapshot(board, copy.words, scores, &generation, SNAPSHOT_ATTEMPTS) &&
+            generation != shown) {
+            render(&copy, scores, generation, width);
+            shown = generation;
+        }
+        ms_sleep(1000 / fps);
+    }
+
+    if (board_shm_snapshot(board, copy.words, scores, &generation, SNAPSHOT_ATTEMPTS))
+        render(&copy, scores, generation, width);
+    printf("game over\n");
+
+    destroy_owners(&copy);
+    return 0;
+}